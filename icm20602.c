@@ -1,19 +1,753 @@
 #include "icm20602.h"
 
-static icm_dev_t icmConfig = {0};
+#include <stdlib.h>
+#include <string.h>
+
+#if ICM_CFG_SELF_TEST
+static uint8_t icmFifoBuffer[ICM_FIFO_SIZE];
+#endif
+
+#if ICM_CFG_LAYOUT == ICM_CFG_LAYOUT_RUNTIME
+#define ICM_ROW_LEN(ctx) ((ctx)->state.fifoRowLen)
+// Row length the rate planner assumes without a device, the longer row gives the smaller FIFO capacity
+#define ICM_PLAN_ROW_LEN ICM_FIFO_ROW_LEN_BOTH
+#else
+#define ICM_ROW_LEN(ctx) ICM_CFG_FIFO_ROW_LEN
+#define ICM_PLAN_ROW_LEN ICM_CFG_FIFO_ROW_LEN
+#endif
+
+#if ICM_CFG_RATE_PLAN
+typedef struct {
+    icm_gyro_dlpf_t dlpf;
+    uint16_t bandwidth_hz;
+    uint32_t delay_us;
+    uint32_t internal_rate_hz;
+} icm_gyro_path_t;
+
+typedef struct {
+    icm_accel_dlpf_t dlpf;
+    uint16_t bandwidth_hz;
+} icm_accel_path_t;
+
+static const icm_gyro_path_t icmGyroPaths[] = {
+    {ICM_GYRO_LPF_5HZ_RATE_1KHZ, 5, 33480, 1000},
+    {ICM_GYRO_LPF_10HZ_RATE_1KHZ, 10, 17850, 1000},
+    {ICM_GYRO_LPF_20HZ_RATE_1KHZ, 20, 9900, 1000},
+    {ICM_GYRO_LPF_41HZ_RATE_1KHZ, 41, 5900, 1000},
+    {ICM_GYRO_LPF_92HZ_RATE_1KHZ, 92, 3900, 1000},
+    {ICM_GYRO_LPF_176HZ_RATE_1KHZ, 176, 2900, 1000},
+    {ICM_GYRO_LPF_250HZ_RATE_8KHZ, 250, 970, 8000},
+    {ICM_GYRO_LPF_3281HZ_RATE_8KHZ, 3281, 170, 8000},
+    {ICM_GYRO_LPF_BYPASS_3281HZ_RATE_32KHZ, 3281, 110, 32000},
+    {ICM_GYRO_LPF_BYPASS_8173HZ_RATE_32KHZ, 8173, 64, 32000},
+};
+
+static const icm_accel_path_t icmAccelPaths[] = {
+    {ICM_ACCEL_LPF_5HZ_RATE_1KHZ, 5},
+    {ICM_ACCEL_LPF_10HZ_RATE_1KHZ, 10},
+    {ICM_ACCEL_LPF_21HZ_RATE_1KHZ, 21},
+    {ICM_ACCEL_LPF_44HZ_RATE_1KHZ, 44},
+    {ICM_ACCEL_LPF_99HZ_RATE_1KHZ, 99},
+    {ICM_ACCEL_LPF_218HZ_RATE_1KHZ, 218},
+    {ICM_ACCEL_LPF_420HZ_RATE_1KHZ, 420},
+    {ICM_ACCEL_LPF_BYPASS_1046HZ_RATE_4KHZ, 1046},
+};
+#endif /* ICM_CFG_RATE_PLAN */
+
+#if ICM_CFG_HAS_ACCEL
+static uint8_t icmAccelSensitivityShift(icm_accel_g_range_t accel_g_range)
+{
+    switch (accel_g_range)
+    {
+    case (ICM_ACCEL_RANGE_2G):
+        return ICM_ACCEL_SENSITIVITY_SHIFT_2G;
+    case (ICM_ACCEL_RANGE_4G):
+        return ICM_ACCEL_SENSITIVITY_SHIFT_4G;
+    case (ICM_ACCEL_RANGE_8G):
+        return ICM_ACCEL_SENSITIVITY_SHIFT_8G;
+    case (ICM_ACCEL_RANGE_16G):
+    default:
+        return ICM_ACCEL_SENSITIVITY_SHIFT_16G;
+    }
+}
+
+/**
+ * @brief Accelerometer conversion factor of a range, in the form the selected conversion path uses.
+ */
+static icm_accel_scale_t icmAccelScale(icm_accel_g_range_t accel_g_range)
+{
+#if ICM_CFG_FIXED_POINT
+    return icmAccelSensitivityShift(accel_g_range);
+#else
+    return 1000.0f / (float)(1 << icmAccelSensitivityShift(accel_g_range));
+#endif
+}
+
+static int16_t icmAccelConvert(int16_t raw, icm_accel_scale_t scale)
+{
+#if ICM_CFG_FIXED_POINT
+    return (int16_t)((raw * 1000) >> scale);
+#else
+    return (int16_t)(raw * scale);
+#endif
+}
+#endif /* ICM_CFG_HAS_ACCEL */
+
+#if ICM_CFG_HAS_GYRO
+static uint16_t icmGyroSensitivity(icm_gyro_dps_t gyro_dps)
+{
+    switch (gyro_dps)
+    {
+    case (ICM_GYRO_RANGE_250_DPS):
+        return ICM_GYRO_SENSITIVITY_250_DPS;
+    case (ICM_GYRO_RANGE_500_DPS):
+        return ICM_GYRO_SENSITIVITY_500_DPS;
+    case (ICM_GYRO_RANGE_1000_DPS):
+        return ICM_GYRO_SENSITIVITY_1000_DPS;
+    case (ICM_GYRO_RANGE_2000_DPS):
+    default:
+        return ICM_GYRO_SENSITIVITY_2000_DPS;
+    }
+}
+
+/**
+ * @brief Gyroscope conversion factor of a range, in the form the selected conversion path uses.
+ */
+static icm_gyro_scale_t icmGyroScale(icm_gyro_dps_t gyro_dps)
+{
+#if ICM_CFG_FIXED_POINT
+    return icmGyroSensitivity(gyro_dps);
+#else
+    return 10.0f / icmGyroSensitivity(gyro_dps);
+#endif
+}
+
+static int16_t icmGyroConvert(int16_t raw, icm_gyro_scale_t scale)
+{
+#if ICM_CFG_FIXED_POINT
+    return (int16_t)((raw * 10) / scale);
+#else
+    return (int16_t)(raw * scale);
+#endif
+}
+#endif /* ICM_CFG_HAS_GYRO */
+
+#if ICM_CFG_TEMPERATURE
+static int8_t icmTempConvert(int16_t raw)
+{
+    return (int8_t)(((raw * 10) / ICM_TEMP_SENSITIVITY) + ICM_ROOM_TEMP_OFFSET);
+}
+#endif
+
+/**
+ * @brief SMPLRT_DIV whose rate 1000 / (1 + SMPLRT_DIV) is closest to the requested rate.
+ *
+ * @note Rounding the divider is not enough, the rate is inverse to it. The floor divider gives the next rate at or
+ *       above the request and the one after it the next rate below, the smaller rate error of both wins.
+ */
+static uint8_t icmSampleRateDivider(uint16_t sample_rate_hz)
+{
+    uint32_t rate    = sample_rate_hz;
+    uint32_t divisor = 0;
+
+    if (rate <= 4)
+    {
+        rate = 4;
+    }
+    if (rate >= 1000)
+    {
+        rate = 1000;
+    }
+    divisor = 1000 / rate;
+    if ((1000 - rate * divisor) * (divisor + 1) > (rate * (divisor + 1) - 1000) * divisor)
+    {
+        divisor++;
+    }
+    return (uint8_t)(divisor - 1);
+}
+
+/**
+ * @brief Run one register transfer within the retry budget.
+ *
+ * @note The transfer is tried ICM_CFG_BUS_RETRIES + 1 times. If every attempt fails the recovery hook runs once and
+ *       the transfer gets one last attempt, so a call costs at most ICM_CFG_BUS_RETRIES + 2 transfers.
+ */
+static icm_status_t icmTransfer(icmdev_ctx_t *ctx, uint8_t reg, uint8_t *p_read, const uint8_t *p_write,
+                                uint16_t len)
+{
+    uint8_t attempt = 0;
+
+    for (attempt = 0; attempt <= ICM_CFG_BUS_RETRIES + 1; attempt++)
+    {
+        int32_t ret = 0;
+
+        if (attempt == ICM_CFG_BUS_RETRIES + 1)
+        {
+            if ((ctx->recover == NULL) || (ctx->recover(ctx->handle) != 0))
+            {
+                break;
+            }
+        }
+        ret = p_write ? ctx->write_reg(ctx->handle, reg, p_write, len) : ctx->read_reg(ctx->handle, reg, p_read, len);
+        if (ret == 0)
+        {
+            return ICM_OK;
+        }
+    }
+    return ICM_ERR_BUS;
+}
+
+/**
+ * @brief Read consecutive registers with bounded retry and recovery.
+ *
+ * @note p_buf is only valid when ICM_OK is returned.
+ *
+ * @return ICM_OK, ICM_ERR_BUS @icm_status_t
+ */
+icm_status_t icmReadReg(icmdev_ctx_t *ctx, uint8_t reg, uint8_t *p_buf, uint16_t len)
+{
+    return icmTransfer(ctx, reg, p_buf, NULL, len);
+}
+
+/**
+ * @brief Write consecutive registers with bounded retry and recovery.
+ *
+ * @return ICM_OK, ICM_ERR_BUS @icm_status_t
+ */
+icm_status_t icmWriteReg(icmdev_ctx_t *ctx, uint8_t reg, const uint8_t *p_buf, uint16_t len)
+{
+    return icmTransfer(ctx, reg, NULL, p_buf, len);
+}
+
+/**
+ * @brief Read registers with side effects in a single attempt, without retry or recovery.
+ *
+ * @note For FIFO_R_W and clear-on-read registers like INT_STATUS. A failed attempt may already have popped or
+ *       cleared part of the data, so repeating it would return a different, misaligned result.
+ *
+ * @return ICM_OK, ICM_ERR_BUS @icm_status_t
+ */
+icm_status_t icmReadRegOnce(icmdev_ctx_t *ctx, uint8_t reg, uint8_t *p_buf, uint16_t len)
+{
+    return (ctx->read_reg(ctx->handle, reg, p_buf, len) == 0) ? ICM_OK : ICM_ERR_BUS;
+}
+
+/**
+ * @brief Flush the FIFO with USER_CTRL.FIFO_RST, the FIFO stays enabled.
+ *
+ * @note Until the flush succeeds icmGetFifoCount retries it first and counts nothing, so rows that follow a lost
+ *       transfer are never framed against a broken row boundary.
+ *
+ * @return ICM_OK, ICM_ERR_BUS @icm_status_t
+ */
+icm_status_t icmResetFifo(icmdev_ctx_t *ctx)
+{
+    icm_user_ctrl_t user_ctrl = {0};
+    icm_status_t ret          = ICM_OK;
+
+    ctx->state.fifo_reset_pending = true;
+    ret                           = icmReadReg(ctx, ICM_REG_USER_CTRL, &user_ctrl.user_ctrl, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    user_ctrl.bits.fifo_rst = true;
+    ret                     = icmWriteReg(ctx, ICM_REG_USER_CTRL, &user_ctrl.user_ctrl, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    ctx->state.fifo_reset_pending = false;
+    return ICM_OK;
+}
+
+static icm_status_t icmWriteWaterMark(icmdev_ctx_t *ctx, uint16_t watermark_bytes)
+{
+    uint8_t vmThreshold[2] = {0};
+    vmThreshold[0]         = (uint8_t)(watermark_bytes >> 8);
+    vmThreshold[1]         = (uint8_t)(watermark_bytes & 0xFF);
+    return icmWriteReg(ctx, ICM_REG_FIFO_WM_TH1, vmThreshold, 2);
+}
 
 /**
  * @brief IMU reset.
  *
  */
-void icmReset(icmdev_ctx_t *ctx)
+icm_status_t icmReset(icmdev_ctx_t *ctx)
 {
     icm_power_managment1_t power_managment1 = {0};
     power_managment1.bits.device_reset      = true;
     power_managment1.bits.temp_dis          = true;
-    ctx->write_reg(NULL, ICM_REG_PWR_MGMT_1, &power_managment1.user_power_managment1, 1);
+    return icmWriteReg(ctx, ICM_REG_PWR_MGMT_1, &power_managment1.user_power_managment1, 1);
 }
 
+/**
+ * @brief Reset the device, poll until the reset bit clears and WHO_AM_I matches.
+ *
+ * @note The device may not answer while it resets, so the poll uses single transfers and a failed one only counts
+ *       as another poll. On SPI a device in reset can read back 0x00, which looks like a cleared reset bit, so the
+ *       reset only counts as complete once WHO_AM_I matches as well. The wait is measured with ctx->get_time_us
+ *       when present, otherwise as the sum of the ctx->delay_us calls.
+ *
+ * @return ICM_OK, ICM_ERR_BUS, ICM_ERR_PARAM without ctx->delay_us and ctx->get_time_us, ICM_ERR_TIMEOUT,
+ *         ICM_ERR_ID if the reset bit cleared but WHO_AM_I never matched @icm_status_t
+ */
+static icm_status_t icmResetAndVerify(icmdev_ctx_t *ctx, icm_init_report_t *result, uint32_t *p_waited_us)
+{
+    icm_power_managment1_t power_managment1 = {0};
+    uint32_t start_us                       = 0;
+    bool id_read                            = false;
+    icm_status_t ret                        = ICM_OK;
+
+    *p_waited_us = 0;
+    if ((ctx->delay_us == NULL) && (ctx->get_time_us == NULL))
+    {
+        return ICM_ERR_PARAM;
+    }
+    start_us = ctx->get_time_us ? ctx->get_time_us() : 0;
+    ret      = icmReset(ctx);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+    while (*p_waited_us < ICM_INIT_RESET_TIMEOUT_US)
+    {
+        if (ctx->delay_us)
+        {
+            ctx->delay_us(ICM_INIT_POLL_US);
+        }
+        *p_waited_us = ctx->get_time_us ? ctx->get_time_us() - start_us : *p_waited_us + ICM_INIT_POLL_US;
+        result->reset_polls++;
+        id_read = false;
+        if ((icmReadRegOnce(ctx, ICM_REG_PWR_MGMT_1, &power_managment1.user_power_managment1, 1) != ICM_OK)
+            || power_managment1.bits.device_reset)
+        {
+            continue;
+        }
+        id_read = (icmReadRegOnce(ctx, ICM_REG_WHO_AM_I, &result->who_am_i, 1) == ICM_OK);
+        if (id_read && (result->who_am_i == ICM_WHO_AM_I))
+        {
+            return ICM_OK;
+        }
+    }
+    return id_read ? ICM_ERR_ID : ICM_ERR_TIMEOUT;
+}
+
+/**
+ * @brief Write the full configuration of icmInit to a freshly reset device.
+ */
+static icm_status_t icmInitConfigure(icmdev_ctx_t *ctx, const icm_init_config_t *config)
+{
+    icm_power_managment1_t power_managment1 = {0};
+    icm_config_t reg_config                 = {0};
+    icm_gyro_config_t gyro_config           = {0};
+    icm_accel_config_t accel_config         = {0};
+    icm_accel_config2_t accel_config2       = {0};
+    icm_fifo_enable_t fifo_enable           = {0};
+    icm_int_pin_config_t int_pin_config     = {0};
+    icm_int_enable_t int_enable             = {0};
+    icm_user_ctrl_t user_ctrl               = {0};
+    uint8_t undoc1                          = ICM_REG_UNDOC1_VALUE;
+    uint8_t burst[5]                        = {0};
+    uint16_t watermark                      = config->watermark_rows;
+    icm_status_t ret                        = ICM_OK;
+
+    power_managment1.bits.clksel = config->clock_source;
+    ret                          = icmWriteReg(ctx, ICM_REG_PWR_MGMT_1, &power_managment1.user_power_managment1, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    ret = icmWriteReg(ctx, ICM_REG_UNDOC1, &undoc1, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+    if (config->gyro_dlpf == ICM_GYRO_LPF_BYPASS_3281HZ_RATE_32KHZ)
+    {
+        gyro_config.bits.fchoice = 2;
+    }
+    else if (config->gyro_dlpf == ICM_GYRO_LPF_BYPASS_8173HZ_RATE_32KHZ)
+    {
+        gyro_config.bits.fchoice = 1;
+    }
+    else
+    {
+        reg_config.bits.dlpf_cfg = config->gyro_dlpf;
+    }
+    gyro_config.bits.fs_sel        = config->gyro_dps;
+    accel_config.bits.accel_fs_sel = config->accel_g_range;
+    if (config->accel_dlpf == ICM_ACCEL_LPF_BYPASS_1046HZ_RATE_4KHZ)
+    {
+        accel_config2.bits.accel_fchoice_b = true;
+    }
+    else
+    {
+        accel_config2.bits.a_dlpf_cfg = config->accel_dlpf;
+    }
+    burst[0] = icmSampleRateDivider(config->sample_rate_hz);
+    burst[1] = reg_config.user_config;
+    burst[2] = gyro_config.user_gyro_config;
+    burst[3] = accel_config.user_accel_config;
+    burst[4] = accel_config2.user_accel_config2;
+    ret      = icmWriteReg(ctx, ICM_REG_SMPLRT_DIV, burst, 5);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+    fifo_enable.bits.accel_fifo_en = config->fifo_accel;
+    fifo_enable.bits.gyro_fifo_en  = config->fifo_gyro;
+    ret                            = icmWriteReg(ctx, ICM_REG_FIFO_EN, &fifo_enable.user_fifo_enable, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+#if ICM_CFG_HAS_ACCEL
+    ctx->state.accel_sensitivity = icmAccelScale(config->accel_g_range);
+#endif
+#if ICM_CFG_HAS_GYRO
+    ctx->state.gyro_sensitivity = icmGyroScale(config->gyro_dps);
+#endif
+#if ICM_CFG_LAYOUT == ICM_CFG_LAYOUT_RUNTIME
+    ctx->state.fifoRowLen = 0;
+    if (config->fifo_accel && config->fifo_gyro)
+    {
+        ctx->state.fifoRowLen = ICM_FIFO_ROW_LEN_BOTH;
+    }
+    else if (config->fifo_accel || config->fifo_gyro)
+    {
+        ctx->state.fifoRowLen = ICM_FIFO_ROW_LEN_SINGLE;
+    }
+#endif
+
+    if (config->fifo_int)
+    {
+        int_pin_config.bits.latch_int_en = true;
+        int_enable.bits.fifo_oflow_en    = true;
+    }
+    burst[0] = int_pin_config.user_int_pin_config;
+    burst[1] = int_enable.user_int_enable;
+    ret      = icmWriteReg(ctx, ICM_REG_INT_PIN_CFG, burst, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+    if (ICM_ROW_LEN(ctx) != 0)
+    {
+        if (watermark > ICM_FIFO_SIZE / ICM_ROW_LEN(ctx))
+        {
+            watermark = ICM_FIFO_SIZE / ICM_ROW_LEN(ctx);
+        }
+        watermark *= ICM_ROW_LEN(ctx);
+        burst[0] = (uint8_t)(watermark >> 8);
+        burst[1] = (uint8_t)(watermark & 0xFF);
+        ret      = icmWriteReg(ctx, ICM_REG_FIFO_WM_TH1, burst, 2);
+        if (ret != ICM_OK)
+        {
+            return ret;
+        }
+    }
+
+    user_ctrl.bits.fifo_en  = (config->fifo_accel || config->fifo_gyro);
+    user_ctrl.bits.fifo_rst = true;
+    burst[0]                = user_ctrl.user_ctrl;
+    burst[1]                = power_managment1.user_power_managment1;
+    burst[2]                = 0;
+    return icmWriteReg(ctx, ICM_REG_USER_CTRL, burst, 3);
+}
+
+/**
+ * @brief Reset and configure the IMU in one verified sequence.
+ *
+ * @note The reset bit is polled every ICM_INIT_POLL_US until the device clears it and WHO_AM_I matches, bounded
+ *       by ICM_INIT_RESET_TIMEOUT_US, instead of sleeping a fixed worst case. Without ctx->delay_us the poll runs
+ *       back to back and ctx->get_time_us bounds it, one of the two is required. Adjacent registers are written in
+ *       single bursts: SMPLRT_DIV..ACCEL_CONFIG_2, INT_PIN_CFG..INT_ENABLE, FIFO_WM_TH1..TH2 and
+ *       USER_CTRL..PWR_MGMT_2.
+ *
+ * @param config Full configuration to apply @icm_init_config_t
+ * @param report Optional, startup time and identity of the device, also filled on failure @icm_init_report_t
+ *
+ * @return ICM_OK, ICM_ERR_BUS, ICM_ERR_PARAM without ctx->delay_us and ctx->get_time_us, ICM_ERR_TIMEOUT if the
+ *         reset did not complete, ICM_ERR_ID if WHO_AM_I does not match @icm_status_t
+ */
+icm_status_t icmInit(icmdev_ctx_t *ctx, const icm_init_config_t *config, icm_init_report_t *report)
+{
+    icm_init_report_t result = {0};
+    uint32_t start_us        = ctx->get_time_us ? ctx->get_time_us() : 0;
+    uint32_t waited_us       = 0;
+    icm_status_t ret         = ICM_OK;
+
+    ret = icmResetAndVerify(ctx, &result, &waited_us);
+    if (ret == ICM_OK)
+    {
+        ret = icmInitConfigure(ctx, config);
+    }
+
+    if (ctx->get_time_us)
+    {
+        result.startup_us = ctx->get_time_us() - start_us;
+    }
+    else
+    {
+        result.startup_us = waited_us;
+    }
+    if (report)
+    {
+        *report = result;
+    }
+    return ret;
+}
+
+#if ICM_CFG_SELF_TEST
+/**
+ * @brief Average accelerometer and gyroscope over ICM_SELF_TEST_SAMPLES rows drained from FIFO in bursts.
+ */
+static icm_status_t icmSelfTestAverage(icmdev_ctx_t *ctx, int16_t accel[3], int16_t gyro[3])
+{
+    icm_user_ctrl_t user_ctrl = {0};
+    icm_raw_data_t raw        = {0};
+    int32_t accel_sum[3]      = {0};
+    int32_t gyro_sum[3]       = {0};
+    uint16_t collected        = 0;
+    uint16_t rows             = 0;
+    uint16_t polls            = 0;
+    uint16_t i                = 0;
+    uint8_t axis              = 0;
+    icm_status_t ret          = ICM_OK;
+
+    user_ctrl.bits.fifo_en  = true;
+    user_ctrl.bits.fifo_rst = true;
+    ret                     = icmWriteReg(ctx, ICM_REG_USER_CTRL, &user_ctrl.user_ctrl, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+    while ((collected < ICM_SELF_TEST_SAMPLES) && (polls < ICM_SELF_TEST_MAX_POLLS))
+    {
+        uint16_t max_rows = ICM_SELF_TEST_SAMPLES - collected;
+        if (max_rows > ICM_FIFO_SIZE / ICM_FIFO_ROW_LEN_BOTH)
+        {
+            max_rows = ICM_FIFO_SIZE / ICM_FIFO_ROW_LEN_BOTH;
+        }
+        ctx->delay_us(ICM_SELF_TEST_POLL_US);
+        polls++;
+        ret = icmReadFifo(ctx, ICM_FIFO_ROW_LEN_BOTH, icmFifoBuffer, max_rows, &rows);
+        if (ret != ICM_OK)
+        {
+            return ret;
+        }
+        for (i = 0; i < rows; i++)
+        {
+            icmParseFifoRow(&icmFifoBuffer[i * ICM_FIFO_ROW_LEN_BOTH], true, true, &raw);
+            for (axis = 0; axis < 3; axis++)
+            {
+                accel_sum[axis] += raw.accel[axis];
+                gyro_sum[axis] += raw.gyro[axis];
+            }
+        }
+        collected += rows;
+    }
+    if (collected < ICM_SELF_TEST_SAMPLES)
+    {
+        return ICM_ERR_TIMEOUT;
+    }
+    for (axis = 0; axis < 3; axis++)
+    {
+        accel[axis] = (int16_t)(accel_sum[axis] / collected);
+        gyro[axis]  = (int16_t)(gyro_sum[axis] / collected);
+    }
+    return ICM_OK;
+}
+
+/**
+ * @brief Factory self-test response for a SELF_TEST_* trim code at 250 dps / 2 g.
+ */
+static int32_t icmSelfTestFactory(uint8_t code)
+{
+    if (code == 0)
+    {
+        return 0;
+    }
+    return (int32_t)(2620.0f * powf(1.01f, (float)(code - 1)) + 0.5f);
+}
+
+/**
+ * @brief Run the factory self-test and compare the response against the trim values stored in the device.
+ *
+ * @note The device should be awake with all axes enabled. ctx->delay_us is required to pace the FIFO polls.
+ *       Both averages are drained from FIFO in bursts at 1 kHz, so the test takes about half a second.
+ *       Sample rate, filter, range, FIFO_EN and USER_CTRL are restored afterwards and the FIFO is reset, also when
+ *       the test stopped on a bus error.
+ *
+ * @param result Per axis response, factory value, relative deviation and pass/fail @icm_self_test_t
+ *
+ * @return ICM_OK if every axis passed, ICM_ERR_SELFTEST if one failed, ICM_ERR_PARAM without ctx->delay_us,
+ *         ICM_ERR_TIMEOUT if the FIFO did not deliver enough rows, ICM_ERR_BUS @icm_status_t
+ */
+icm_status_t icmSelfTest(icmdev_ctx_t *ctx, icm_self_test_t *result)
+{
+    icm_config_t config               = {0};
+    icm_gyro_config_t gyro_config     = {0};
+    icm_accel_config_t accel_config   = {0};
+    icm_accel_config2_t accel_config2 = {0};
+    icm_fifo_enable_t fifo_enable     = {0};
+    icm_user_ctrl_t user_ctrl         = {0};
+    uint8_t saved_config[5]           = {0};
+    uint8_t saved_fifo_en             = 0;
+    uint8_t saved_user_ctrl           = 0;
+    uint8_t burst[5]                  = {0};
+    uint8_t codes[6]                  = {0};
+    int16_t accel_off[3]              = {0};
+    int16_t gyro_off[3]               = {0};
+    int16_t accel_on[3]               = {0};
+    int16_t gyro_on[3]                = {0};
+    icm_status_t ret                  = ICM_OK;
+    icm_status_t restore              = ICM_OK;
+    uint8_t axis                      = 0;
+
+    memset(result, 0, sizeof(*result));
+    if (ctx->delay_us == NULL)
+    {
+        return ICM_ERR_PARAM;
+    }
+
+    ret = icmReadReg(ctx, ICM_REG_SELF_TEST_X_ACCEL, &codes[0], 3);
+    if (ret == ICM_OK)
+    {
+        ret = icmReadReg(ctx, ICM_REG_SELF_TEST_X_GYRO, &codes[3], 3);
+    }
+    if (ret == ICM_OK)
+    {
+        ret = icmReadReg(ctx, ICM_REG_SMPLRT_DIV, saved_config, 5);
+    }
+    if (ret == ICM_OK)
+    {
+        ret = icmReadReg(ctx, ICM_REG_FIFO_EN, &saved_fifo_en, 1);
+    }
+    if (ret == ICM_OK)
+    {
+        ret = icmReadReg(ctx, ICM_REG_USER_CTRL, &saved_user_ctrl, 1);
+    }
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+    config.bits.dlpf_cfg           = ICM_GYRO_LPF_92HZ_RATE_1KHZ;
+    gyro_config.bits.fs_sel        = ICM_GYRO_RANGE_250_DPS;
+    accel_config.bits.accel_fs_sel = ICM_ACCEL_RANGE_2G;
+    accel_config2.bits.a_dlpf_cfg  = ICM_ACCEL_LPF_99HZ_RATE_1KHZ;
+    burst[0]                       = 0;
+    burst[1]                       = config.user_config;
+    burst[2]                       = gyro_config.user_gyro_config;
+    burst[3]                       = accel_config.user_accel_config;
+    burst[4]                       = accel_config2.user_accel_config2;
+    ret                            = icmWriteReg(ctx, ICM_REG_SMPLRT_DIV, burst, 5);
+
+    fifo_enable.bits.accel_fifo_en = true;
+    fifo_enable.bits.gyro_fifo_en  = true;
+    if (ret == ICM_OK)
+    {
+        ret = icmWriteReg(ctx, ICM_REG_FIFO_EN, &fifo_enable.user_fifo_enable, 1);
+    }
+    if (ret == ICM_OK)
+    {
+        ctx->delay_us(ICM_SELF_TEST_SETTLE_US);
+        ret = icmSelfTestAverage(ctx, accel_off, gyro_off);
+    }
+
+    if (ret == ICM_OK)
+    {
+        gyro_config.bits.xg_set = true;
+        gyro_config.bits.yg_set = true;
+        gyro_config.bits.zg_set = true;
+        accel_config.bits.xa_st = true;
+        accel_config.bits.ya_st = true;
+        accel_config.bits.za_st = true;
+        burst[0]                = gyro_config.user_gyro_config;
+        burst[1]                = accel_config.user_accel_config;
+        ret                     = icmWriteReg(ctx, ICM_REG_GYRO_CONFIG, burst, 2);
+    }
+    if (ret == ICM_OK)
+    {
+        ctx->delay_us(ICM_SELF_TEST_SETTLE_US);
+        ret = icmSelfTestAverage(ctx, accel_on, gyro_on);
+    }
+
+    /* restore even after a failed step, the first error is the one reported */
+    restore = icmWriteReg(ctx, ICM_REG_SMPLRT_DIV, saved_config, 5);
+    if (restore == ICM_OK)
+    {
+        restore = icmWriteReg(ctx, ICM_REG_FIFO_EN, &saved_fifo_en, 1);
+    }
+    user_ctrl.user_ctrl     = saved_user_ctrl;
+    user_ctrl.bits.fifo_rst = true;
+    if (restore == ICM_OK)
+    {
+        restore = icmWriteReg(ctx, ICM_REG_USER_CTRL, &user_ctrl.user_ctrl, 1);
+    }
+
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    if (restore != ICM_OK)
+    {
+        return restore;
+    }
+
+    result->pass = true;
+    for (axis = 0; axis < 3; axis++)
+    {
+        int32_t accel_str = (int32_t)accel_on[axis] - accel_off[axis];
+        int32_t gyro_str  = (int32_t)gyro_on[axis] - gyro_off[axis];
+
+        result->accel_response[axis] = accel_str;
+        result->gyro_response[axis]  = gyro_str;
+        result->accel_factory[axis]  = icmSelfTestFactory(codes[axis]);
+        result->gyro_factory[axis]   = icmSelfTestFactory(codes[3 + axis]);
+
+        if (result->accel_factory[axis] != 0)
+        {
+            float ratio                   = (float)accel_str / result->accel_factory[axis];
+            result->accel_deviation[axis] = ratio - 1.0f;
+            result->accel_pass[axis]
+                = (ratio > ICM_SELF_TEST_ACCEL_MIN_RATIO) && (ratio < ICM_SELF_TEST_ACCEL_MAX_RATIO);
+        }
+        else
+        {
+            result->accel_pass[axis]
+                = (labs(accel_str) >= ICM_SELF_TEST_ACCEL_MIN_LSB) && (labs(accel_str) <= ICM_SELF_TEST_ACCEL_MAX_LSB);
+        }
+
+        if (result->gyro_factory[axis] != 0)
+        {
+            float ratio                  = (float)gyro_str / result->gyro_factory[axis];
+            result->gyro_deviation[axis] = ratio - 1.0f;
+            result->gyro_pass[axis]      = (ratio > ICM_SELF_TEST_GYRO_MIN_RATIO);
+        }
+        else
+        {
+            result->gyro_pass[axis] = (labs(gyro_str) >= ICM_SELF_TEST_GYRO_MIN_LSB);
+        }
+        if (abs(gyro_off[axis]) > ICM_SELF_TEST_GYRO_MAX_OFFSET_LSB)
+        {
+            result->gyro_pass[axis] = false;
+        }
+
+        result->pass = result->pass && result->accel_pass[axis] && result->gyro_pass[axis];
+    }
+    return result->pass ? ICM_OK : ICM_ERR_SELFTEST;
+}
+#endif
+
 /**
  * @brief Set the clock source to IMU.
  *
@@ -21,34 +755,177 @@ void icmReset(icmdev_ctx_t *ctx)
  *                     1,2,3,4,5: Auto selects the best available clock source � PLL if ready, else use the Internal
  * oscillator 7: Stops the clock and keeps timing generator in reset
  */
-void icmSetClock(icmdev_ctx_t *ctx, uint8_t clock_source)
+icm_status_t icmSetClock(icmdev_ctx_t *ctx, uint8_t clock_source)
 {
     icm_power_managment1_t power_managment1 = {0};
-    ctx->read_reg(NULL, ICM_REG_PWR_MGMT_1, &power_managment1.user_power_managment1, 1);
+    icm_status_t ret                        = ICM_OK;
+
+    ret = icmReadReg(ctx, ICM_REG_PWR_MGMT_1, &power_managment1.user_power_managment1, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
     power_managment1.bits.clksel = clock_source;
-    ctx->write_reg(NULL, ICM_REG_PWR_MGMT_1, &power_managment1.user_power_managment1, 1);
+    return icmWriteReg(ctx, ICM_REG_PWR_MGMT_1, &power_managment1.user_power_managment1, 1);
 }
 
 /**
  * @brief Set the sample rate divider to IMU.
  *
+ * @note The divider only applies to the 1 kHz gyroscope filter settings. The divider giving the closest rate is
+ *       chosen, the effective rate is 1000 / (1 + SMPLRT_DIV). Use icmPlanRate for the 8 kHz and 32 kHz paths.
+ *
  * @param sample_rate_hz Sample rate range should be 4 - 1000.
  *                       1 = 1 Hz, 1000 = 1Khz.
  */
-void icmSetSampleRate(icmdev_ctx_t *ctx, uint16_t sample_rate_hz)
+icm_status_t icmSetSampleRate(icmdev_ctx_t *ctx, uint16_t sample_rate_hz)
+{
+    uint8_t val = icmSampleRateDivider(sample_rate_hz);
+    return icmWriteReg(ctx, ICM_REG_SMPLRT_DIV, &val, 1);
+}
+
+#if ICM_CFG_RATE_PLAN
+/**
+ * @brief Plan output rate, filters and FIFO watermark for a target rate, bandwidth and latency budget.
+ *
+ * @note Every gyroscope path is considered, including the 8 kHz and 32 kHz paths where SMPLRT_DIV has no effect.
+ *       A path qualifies when its bandwidth covers bandwidth_hz, its effective rate is within ICM_PLAN_MAX_RATE_ERROR
+ *       of odr_hz and its group delay plus one sample period plus ICM_CFG_DRAIN_US fits the budget. Among those the
+ *       closest effective rate wins, then the narrowest bandwidth, then the shortest delay. The watermark is the
+ *       largest row count whose buffering time still fits the remaining budget, which gives the lowest interrupt
+ *       rate. It leaves headroom in the FIFO for the rows that arrive during ICM_CFG_DRAIN_US, at least
+ *       ICM_PLAN_MIN_HEADROOM_ROWS, so the FIFO does not overflow between interrupt and drain. Latency is group delay
+ *       plus watermark buffering time plus drain time. The FIFO capacity is the one of the build layout, the runtime
+ *       layout assumes 14 byte rows.
+ *
+ * @param odr_hz Target output data rate.
+ * @param bandwidth_hz Minimum signal bandwidth to keep.
+ * @param latency_budget_us End-to-end latency budget from signal to FIFO interrupt.
+ * @param plan Chosen settings and resulting rate, delay and interrupt rate @icm_rate_plan_t
+ *
+ * @return false if no path meets rate, bandwidth and latency, plan is left untouched.
+ */
+bool icmPlanRate(float odr_hz, uint16_t bandwidth_hz, uint32_t latency_budget_us, icm_rate_plan_t *plan)
+{
+    const icm_gyro_path_t *best = NULL;
+    float best_rate             = 0;
+    float best_error            = 0;
+    uint8_t best_divider        = 0;
+    uint8_t row_len             = ICM_PLAN_ROW_LEN;
+    uint32_t period_us          = 0;
+    uint32_t rows               = 0;
+    uint32_t headroom           = 0;
+    uint8_t i                   = 0;
+
+    if (odr_hz <= 0)
+    {
+        return false;
+    }
+
+    for (i = 0; i < sizeof(icmGyroPaths) / sizeof(icmGyroPaths[0]); i++)
+    {
+        const icm_gyro_path_t *path = &icmGyroPaths[i];
+        float rate                  = (float)path->internal_rate_hz;
+        uint8_t divider             = 0;
+        float error                 = 0;
+
+        if (path->internal_rate_hz == 1000)
+        {
+            float divisor = floorf(1000.0f / odr_hz);
+            divisor       = (divisor < 1) ? 1 : ((divisor > 256) ? 256 : divisor);
+            if ((divisor < 256) && (fabsf(1000.0f / (divisor + 1) - odr_hz) < fabsf(1000.0f / divisor - odr_hz)))
+            {
+                divisor += 1;
+            }
+            divider = (uint8_t)(divisor - 1);
+            rate    = 1000.0f / (1 + divider);
+        }
+        error = fabsf(rate - odr_hz) / odr_hz;
+        if ((path->bandwidth_hz < bandwidth_hz) || (error > ICM_PLAN_MAX_RATE_ERROR)
+            || (path->delay_us + (uint32_t)(1e6f / rate) + ICM_CFG_DRAIN_US > latency_budget_us))
+        {
+            continue;
+        }
+        if ((best == NULL) || (error < best_error - 1e-6f)
+            || ((error <= best_error + 1e-6f)
+                && ((path->bandwidth_hz < best->bandwidth_hz)
+                    || ((path->bandwidth_hz == best->bandwidth_hz) && (path->delay_us < best->delay_us)))))
+        {
+            best         = path;
+            best_rate    = rate;
+            best_error   = error;
+            best_divider = divider;
+        }
+    }
+    if (best == NULL)
+    {
+        return false;
+    }
+
+    plan->gyro_dlpf         = best->dlpf;
+    plan->divider           = best_divider;
+    plan->effective_rate_hz = best_rate;
+    plan->bandwidth_hz      = best->bandwidth_hz;
+    plan->group_delay_us    = best->delay_us;
+
+    plan->accel_dlpf = ICM_ACCEL_LPF_BYPASS_1046HZ_RATE_4KHZ;
+    for (i = 0; i < sizeof(icmAccelPaths) / sizeof(icmAccelPaths[0]); i++)
+    {
+        if (icmAccelPaths[i].bandwidth_hz >= bandwidth_hz)
+        {
+            plan->accel_dlpf = icmAccelPaths[i].dlpf;
+            break;
+        }
+    }
+
+    period_us = (uint32_t)(1e6f / best_rate);
+    headroom  = (ICM_CFG_DRAIN_US + period_us - 1) / period_us;
+    headroom  = (headroom < ICM_PLAN_MIN_HEADROOM_ROWS) ? ICM_PLAN_MIN_HEADROOM_ROWS : headroom;
+    rows      = (latency_budget_us - best->delay_us - ICM_CFG_DRAIN_US) / period_us;
+    if (rows + headroom > ICM_FIFO_SIZE / row_len)
+    {
+        rows = (headroom < ICM_FIFO_SIZE / row_len) ? ICM_FIFO_SIZE / row_len - headroom : 0;
+    }
+    if (rows == 0)
+    {
+        rows = 1;
+    }
+    plan->watermark_rows    = (uint16_t)rows;
+    plan->latency_us        = best->delay_us + rows * period_us + ICM_CFG_DRAIN_US;
+    plan->interrupt_rate_hz = best_rate / rows;
+    return true;
+}
+
+/**
+ * @brief Program a plan from icmPlanRate.
+ *
+ * @note The watermark is written directly in bytes so the filter setting in CONFIG is kept.
+ *
+ * @param plan Settings to apply @icm_rate_plan_t
+ */
+icm_status_t icmSetRatePlan(icmdev_ctx_t *ctx, const icm_rate_plan_t *plan)
 {
-    uint8_t val = 0;
-    if (sample_rate_hz <= 4)
+    uint8_t row_len  = ICM_ROW_LEN(ctx) ? ICM_ROW_LEN(ctx) : ICM_FIFO_ROW_LEN_BOTH;
+    icm_status_t ret = ICM_OK;
+
+    ret = icmSetGyroLPF(ctx, plan->gyro_dlpf);
+    if (ret != ICM_OK)
     {
-        sample_rate_hz = 4;
+        return ret;
     }
-    if (sample_rate_hz >= 1000)
+    ret = icmSetAccelLPF(ctx, plan->accel_dlpf);
+    if (ret != ICM_OK)
     {
-        sample_rate_hz = 1000;
+        return ret;
     }
-    val = (1000 / sample_rate_hz) - 1;
-    ctx->write_reg(NULL, ICM_REG_SMPLRT_DIV, &val, 1);
+    ret = icmWriteReg(ctx, ICM_REG_SMPLRT_DIV, &plan->divider, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    return icmWriteWaterMark(ctx, plan->watermark_rows * row_len);
 }
+#endif
 
 /**
  * @brief Set FIFO interrupt enable or disable.
@@ -56,22 +933,26 @@ void icmSetSampleRate(icmdev_ctx_t *ctx, uint16_t sample_rate_hz)
  * @param enable 0: Reset
  *               1: Set
  */
-void icmSetFIFOInt(icmdev_ctx_t *ctx, bool enable)
+icm_status_t icmSetFIFOInt(icmdev_ctx_t *ctx, bool enable)
 {
     icm_int_pin_config_t int_pin_config = {0};
     int_pin_config.bits.latch_int_en    = true;
-    ctx->write_reg(NULL, ICM_REG_INT_PIN_CFG, &int_pin_config.user_int_pin_config, 1);
+    icm_status_t ret = icmWriteReg(ctx, ICM_REG_INT_PIN_CFG, &int_pin_config.user_int_pin_config, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
 
     icm_int_enable_t int_enable   = {0};
     int_enable.bits.fifo_oflow_en = true;
-    ctx->write_reg(NULL, ICM_REG_INT_ENABLE, &int_enable.user_int_enable, 1);
+    return icmWriteReg(ctx, ICM_REG_INT_ENABLE, &int_enable.user_int_enable, 1);
 }
 
 /**
  * @brief  Set Water-mark threshold level. This function adjusts the FIFO boundary then can be getting data
  *         from water-mark interrupt when which limit set.
  *
- * @note   Before set to water-mark threshold ensure that configuration register should be 0.
+ * @note   Only FIFO_WM_TH1 and FIFO_WM_TH2 are written, CONFIG keeps its DLPF and FSYNC settings.
  *         The threshold level should be coefficient of which part has enabled and which axis has enabled.
  *         Example: If all axis of accelerometer is enable that means 6 bytes and temperature is 2 byte sum of them is 8
  * bytes. Threshold value should be coefficient of 8.
@@ -81,35 +962,143 @@ void icmSetFIFOInt(icmdev_ctx_t *ctx, bool enable)
  *                     0: Disable.
  *                     Default value is 0.
  */
-void icmSetWaterMarkThreshold(icmdev_ctx_t *ctx, uint16_t wm_threshold)
+icm_status_t icmSetWaterMarkThreshold(icmdev_ctx_t *ctx, uint16_t wm_threshold)
 {
-    icm_config_t config = {0};
-    config.user_config  = 0;
-    if (icmConfig.fifoRowLen == 14)
+    if (ICM_ROW_LEN(ctx) == 14)
     {
         if (wm_threshold >= 72)
         {
             wm_threshold = 72;
         }
-        wm_threshold *= icmConfig.fifoRowLen;
+        wm_threshold *= ICM_ROW_LEN(ctx);
     }
 
-    if (icmConfig.fifoRowLen == 8)
+    if (ICM_ROW_LEN(ctx) == 8)
     {
         if (wm_threshold >= 126)
         {
             wm_threshold = 126;
         }
-        wm_threshold *= icmConfig.fifoRowLen;
+        wm_threshold *= ICM_ROW_LEN(ctx);
     }
 
-    ctx->write_reg(NULL, ICM_REG_CONFIG, &config.user_config, 1);
-    uint8_t vmThreshold[2] = {0};
-    vmThreshold[0]         = (uint8_t)(wm_threshold >> 8);
-    vmThreshold[1]         = (uint8_t)(wm_threshold & 0xFF);
-    ctx->write_reg(NULL, ICM_REG_FIFO_WM_TH1, vmThreshold, 2);
+    return icmWriteWaterMark(ctx, wm_threshold);
 }
 
+#if ICM_CFG_WM_CTRL
+/**
+ * @brief Initialize the adaptive water-mark controller and program the starting threshold.
+ *
+ * @param row_len FIFO row length in bytes, ICM_FIFO_ROW_LEN_SINGLE or ICM_FIFO_ROW_LEN_BOTH.
+ * @param odr_hz Output data rate written to the FIFO.
+ * @param min_rows Lowest threshold the controller may set, at least 1.
+ * @param max_rows Highest threshold the controller may set, clamped to the FIFO capacity.
+ * @param headroom_rows Free rows to keep in the FIFO when the consumer arrives late.
+ *
+ * @return ICM_OK, ICM_ERR_PARAM for row_len 0, ICM_ERR_BUS @icm_status_t
+ */
+icm_status_t icmWaterMarkCtrlInit(icmdev_ctx_t *ctx, icm_wm_ctrl_t *ctrl, uint8_t row_len, uint32_t odr_hz,
+                                  uint16_t min_rows, uint16_t max_rows, uint16_t headroom_rows)
+{
+    uint16_t capacity = 0;
+
+    if (row_len == 0)
+    {
+        return ICM_ERR_PARAM;
+    }
+    capacity = ICM_FIFO_SIZE / row_len;
+    memset(ctrl, 0, sizeof(*ctrl));
+    ctrl->row_len       = row_len;
+    ctrl->odr_hz        = odr_hz;
+    ctrl->capacity_rows = capacity;
+    ctrl->headroom_rows = headroom_rows;
+    ctrl->max_rows      = (max_rows > capacity) ? capacity : max_rows;
+    ctrl->min_rows      = (min_rows == 0) ? 1 : min_rows;
+    if (ctrl->min_rows > ctrl->max_rows)
+    {
+        ctrl->min_rows = ctrl->max_rows;
+    }
+    ctrl->watermark_rows = ctrl->min_rows;
+    return icmWriteWaterMark(ctx, ctrl->watermark_rows * row_len);
+}
+
+/**
+ * @brief Feed one service observation to the controller and retune the threshold when needed.
+ *
+ * @note Rows that arrive between the water-mark interrupt and the drain are estimated from both the fill above the
+ *       threshold and the reported latency. A decaying peak of that lag sets the threshold to
+ *       capacity - headroom - lag, so the interrupt rate is as low as the consumer jitter allows. The register is
+ *       only rewritten when the change exceeds ICM_WM_CTRL_HYSTERESIS_ROWS. A full FIFO drops the threshold to
+ *       the minimum at once. Every rewrite counts in ctrl->retunes. A failed write is retried on the next update.
+ *
+ * @param fill_rows FIFO rows counted when the consumer started draining.
+ * @param latency_us Time from water-mark interrupt to drain, 0 if unknown.
+ *
+ * @return ICM_OK, also when the threshold was kept, or ICM_ERR_BUS @icm_status_t
+ */
+icm_status_t icmWaterMarkCtrlUpdate(icmdev_ctx_t *ctx, icm_wm_ctrl_t *ctrl, uint16_t fill_rows, uint32_t latency_us)
+{
+    uint32_t lag_rows     = 0;
+    uint32_t latency_rows = (uint32_t)(((uint64_t)latency_us * ctrl->odr_hz) / 1000000);
+    int32_t target        = 0;
+    int32_t delta         = 0;
+    icm_status_t ret      = ICM_OK;
+
+    if (fill_rows > ctrl->watermark_rows)
+    {
+        lag_rows = fill_rows - ctrl->watermark_rows;
+    }
+    if (latency_rows > lag_rows)
+    {
+        lag_rows = latency_rows;
+    }
+
+    if (fill_rows >= ctrl->capacity_rows)
+    {
+        ctrl->overflows++;
+        ctrl->lag_peak_rows = ctrl->capacity_rows;
+    }
+    else
+    {
+        ctrl->lag_peak_rows -= (ctrl->lag_peak_rows + (1 << ICM_WM_CTRL_DECAY_SHIFT) - 1) >> ICM_WM_CTRL_DECAY_SHIFT;
+        if (lag_rows > ctrl->lag_peak_rows)
+        {
+            ctrl->lag_peak_rows = (uint16_t)lag_rows;
+        }
+    }
+
+    target = (int32_t)ctrl->capacity_rows - ctrl->headroom_rows - ctrl->lag_peak_rows;
+    if (target < ctrl->min_rows)
+    {
+        target = ctrl->min_rows;
+    }
+    if (target > ctrl->max_rows)
+    {
+        target = ctrl->max_rows;
+    }
+
+    delta = target - ctrl->watermark_rows;
+    if ((fill_rows < ctrl->capacity_rows) && (delta < ICM_WM_CTRL_HYSTERESIS_ROWS)
+        && (delta > -ICM_WM_CTRL_HYSTERESIS_ROWS))
+    {
+        return ICM_OK;
+    }
+    if (delta == 0)
+    {
+        return ICM_OK;
+    }
+    ret = icmWriteWaterMark(ctx, (uint16_t)target * ctrl->row_len);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    ctrl->watermark_rows = (uint16_t)target;
+    ctrl->retunes++;
+    return ICM_OK;
+}
+#endif
+
+#if ICM_CFG_WOM
 // TODO
 /**
  * @brief Use Accelerometer with wake on motion mode. Set the threshold value then check WoM interrupt
@@ -124,40 +1113,37 @@ void icmSetWaterMarkThreshold(icmdev_ctx_t *ctx, uint16_t wm_threshold)
  * @param z_wom_th
  *        0: Disable
  */
-void icmSetAccelWoMThresholdAxis(icmdev_ctx_t *ctx, uint8_t x_wom_th, uint8_t y_wom_th, uint8_t z_wom_th)
+icm_status_t icmSetAccelWoMThresholdAxis(icmdev_ctx_t *ctx, uint8_t x_wom_th, uint8_t y_wom_th, uint8_t z_wom_th)
 {
     icm_accel_intel_ctrl_t accel_intel_ctrl = {0};
     icm_int_enable_t int_enable             = {0};
+    icm_status_t ret                        = ICM_OK;
 
-    ctx->read_reg(NULL, ICM_REG_INT_ENABLE, &int_enable.user_int_enable, 1);
-    if (x_wom_th != 0)
+    ret = icmReadReg(ctx, ICM_REG_INT_ENABLE, &int_enable.user_int_enable, 1);
+    if ((ret == ICM_OK) && (x_wom_th != 0))
     {
-        int_enable.bits.wom_x_int_en = true;
-        ctx->write_reg(NULL, ICM_REG_ACCEL_WOM_X_THR, &x_wom_th, 1);
+        ret = icmWriteReg(ctx, ICM_REG_ACCEL_WOM_X_THR, &x_wom_th, 1);
     }
-    else
+    if ((ret == ICM_OK) && (y_wom_th != 0))
     {
-        int_enable.bits.wom_x_int_en = false;
+        ret = icmWriteReg(ctx, ICM_REG_ACCEL_WOM_Y_THR, &y_wom_th, 1);
     }
-    if (y_wom_th != 0)
+    if ((ret == ICM_OK) && (z_wom_th != 0))
     {
-        int_enable.bits.wom_y_int_en = true;
-        ctx->write_reg(NULL, ICM_REG_ACCEL_WOM_Y_THR, &y_wom_th, 1);
+        ret = icmWriteReg(ctx, ICM_REG_ACCEL_WOM_Z_THR, &z_wom_th, 1);
     }
-    else
+    if (ret != ICM_OK)
     {
-        int_enable.bits.wom_y_int_en = false;
+        return ret;
     }
-    if (z_wom_th != 0)
+    int_enable.bits.wom_x_int_en = (x_wom_th != 0);
+    int_enable.bits.wom_y_int_en = (y_wom_th != 0);
+    int_enable.bits.wom_z_int_en = (z_wom_th != 0);
+    ret                          = icmWriteReg(ctx, ICM_REG_INT_ENABLE, &int_enable.user_int_enable, 1);
+    if (ret != ICM_OK)
     {
-        int_enable.bits.wom_z_int_en = true;
-        ctx->write_reg(NULL, ICM_REG_ACCEL_WOM_Z_THR, &z_wom_th, 1);
+        return ret;
     }
-    else
-    {
-        int_enable.bits.wom_z_int_en = false;
-    }
-    ctx->write_reg(NULL, ICM_REG_INT_ENABLE, &int_enable.user_int_enable, 1);
     if (x_wom_th || y_wom_th || z_wom_th)
     {
         accel_intel_ctrl.bits.accel_intel_en = true;
@@ -165,31 +1151,35 @@ void icmSetAccelWoMThresholdAxis(icmdev_ctx_t *ctx, uint8_t x_wom_th, uint8_t y_
 
     //    accel_intel_ctrl.bits.accel_intel_mode = true;  //  1 - Compare the current sample with the previous sample
     //    accel_intel_ctrl.bits.wom_th_mode = true;       //  1 - WoM int AND mode    0 - WoM int OR mode
-    ctx->write_reg(NULL, ICM_REG_ACCEL_INTEL_CTRL, &accel_intel_ctrl.user_accel_intel_ctrl, 1);
+    return icmWriteReg(ctx, ICM_REG_ACCEL_INTEL_CTRL, &accel_intel_ctrl.user_accel_intel_ctrl, 1);
 }
+#endif
 
 /**
  * @brief Set accelerometer low pass filter.
  *
  * @param accel_dlpf select the rate of LPF @icm_accel_dlpf_t
  */
-void icmSetAccelLPF(icmdev_ctx_t *ctx, icm_accel_dlpf_t accel_dlpf)
+icm_status_t icmSetAccelLPF(icmdev_ctx_t *ctx, icm_accel_dlpf_t accel_dlpf)
 {
     icm_accel_config2_t accel_config2 = {0};
+    icm_status_t ret                  = ICM_OK;
 
+    ret = icmReadReg(ctx, ICM_REG_ACCEL_CONFIG_2, &accel_config2.user_accel_config2, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
     if (accel_dlpf == ICM_ACCEL_LPF_BYPASS_1046HZ_RATE_4KHZ)
     {
-        ctx->read_reg(NULL, ICM_REG_ACCEL_CONFIG_2, &accel_config2.user_accel_config2, 1);
         accel_config2.bits.accel_fchoice_b = true;
-        ctx->write_reg(NULL, ICM_REG_ACCEL_CONFIG_2, &accel_config2.user_accel_config2, 1);
     }
     else
     {
-        ctx->read_reg(NULL, ICM_REG_ACCEL_CONFIG_2, &accel_config2.user_accel_config2, 1);
         accel_config2.bits.a_dlpf_cfg      = accel_dlpf;
         accel_config2.bits.accel_fchoice_b = false;
-        ctx->write_reg(NULL, ICM_REG_ACCEL_CONFIG_2, &accel_config2.user_accel_config2, 1);
     }
+    return icmWriteReg(ctx, ICM_REG_ACCEL_CONFIG_2, &accel_config2.user_accel_config2, 1);
 }
 
 /**
@@ -197,30 +1187,30 @@ void icmSetAccelLPF(icmdev_ctx_t *ctx, icm_accel_dlpf_t accel_dlpf)
  *
  * @param accel_g_range select the rage of G value @icm_accel_g_range_t
  */
-void icmSetAccelGRange(icmdev_ctx_t *ctx, icm_accel_g_range_t accel_g_range)
+icm_status_t icmSetAccelGRange(icmdev_ctx_t *ctx, icm_accel_g_range_t accel_g_range)
 {
     icm_accel_config_t accel_config = {0};
-    ctx->read_reg(NULL, ICM_REG_ACCEL_CONFIG, &accel_config.user_accel_config, 1);
-    accel_config.bits.accel_fs_sel = accel_g_range;
-    ctx->write_reg(NULL, ICM_REG_ACCEL_CONFIG, &accel_config.user_accel_config, 1);
+    icm_status_t ret                = ICM_OK;
 
-    switch (accel_g_range)
+    ret = icmReadReg(ctx, ICM_REG_ACCEL_CONFIG, &accel_config.user_accel_config, 1);
+    if (ret != ICM_OK)
     {
-    case (ICM_ACCEL_RANGE_2G):
-        icmConfig.accel_sensitivity = ICM_ACCEL_SENSITIVITY_SHIFT_2G;
-        break;
-    case (ICM_ACCEL_RANGE_4G):
-        icmConfig.accel_sensitivity = ICM_ACCEL_SENSITIVITY_SHIFT_4G;
-        break;
-    case (ICM_ACCEL_RANGE_8G):
-        icmConfig.accel_sensitivity = ICM_ACCEL_SENSITIVITY_SHIFT_8G;
-        break;
-    case (ICM_ACCEL_RANGE_16G):
-        icmConfig.accel_sensitivity = ICM_ACCEL_SENSITIVITY_SHIFT_16G;
-        break;
+        return ret;
     }
+    accel_config.bits.accel_fs_sel = accel_g_range;
+    ret                            = icmWriteReg(ctx, ICM_REG_ACCEL_CONFIG, &accel_config.user_accel_config, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+#if ICM_CFG_HAS_ACCEL
+    ctx->state.accel_sensitivity = icmAccelScale(accel_g_range);
+#endif
+    return ICM_OK;
 }
 
+#if ICM_CFG_OFFSETS
 // TODO
 /**
  * @brief Set accelerometer axis to offset value.
@@ -229,19 +1219,28 @@ void icmSetAccelGRange(icmdev_ctx_t *ctx, icm_accel_g_range_t accel_g_range)
  * @param y_offset
  * @param z_offset
  */
-void icmSetAccelOffsetAxis(icmdev_ctx_t *ctx, uint16_t x_offset, uint16_t y_offset, uint16_t z_offset)
+icm_status_t icmSetAccelOffsetAxis(icmdev_ctx_t *ctx, uint16_t x_offset, uint16_t y_offset, uint16_t z_offset)
 {
     uint8_t offset[2] = {0};
+    icm_status_t ret  = ICM_OK;
 
     offset[0] = (uint8_t)(x_offset >> 8);
     offset[1] = (uint8_t)(x_offset & 0xFF);
-    ctx->write_reg(NULL, ICM_REG_XA_OFFSET_H, offset, 2);
+    ret       = icmWriteReg(ctx, ICM_REG_XA_OFFSET_H, offset, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
     offset[0] = (uint8_t)(y_offset >> 8);
     offset[1] = (uint8_t)(y_offset & 0xFF);
-    ctx->write_reg(NULL, ICM_REG_YA_OFFSET_H, offset, 2);
+    ret       = icmWriteReg(ctx, ICM_REG_YA_OFFSET_H, offset, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
     offset[0] = (uint8_t)(z_offset >> 8);
     offset[1] = (uint8_t)(z_offset & 0xFF);
-    ctx->write_reg(NULL, ICM_REG_ZA_OFFSET_H, offset, 2);
+    return icmWriteReg(ctx, ICM_REG_ZA_OFFSET_H, offset, 2);
 }
 
 /**
@@ -249,15 +1248,22 @@ void icmSetAccelOffsetAxis(icmdev_ctx_t *ctx, uint16_t x_offset, uint16_t y_offs
  *
  * @param accel_offset Select which axis of offset get @icm_offset_t
  */
-void icmGetAccelOffsetAxis(icmdev_ctx_t *ctx, icm_offset_t *accel_offset)
+icm_status_t icmGetAccelOffsetAxis(icmdev_ctx_t *ctx, icm_offset_t *accel_offset)
 {
     uint8_t offset_val[6] = {0};
+    icm_status_t ret      = ICM_OK;
 
-    ctx->read_reg(NULL, ICM_REG_XA_OFFSET_H, offset_val, 6);
+    ret = icmReadReg(ctx, ICM_REG_XA_OFFSET_H, offset_val, 6);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
     accel_offset->x = ((uint16_t)offset_val[0] << 8) | offset_val[1];
     accel_offset->y = ((uint16_t)offset_val[2] << 8) | offset_val[3];
     accel_offset->z = ((uint16_t)offset_val[4] << 8) | offset_val[5];
+    return ICM_OK;
 }
+#endif
 
 /**
  * @brief Set accelerometer axis enable or disable.
@@ -271,27 +1277,35 @@ void icmGetAccelOffsetAxis(icmdev_ctx_t *ctx, icm_offset_t *accel_offset)
  * @param accel_z 0: Reset
  *                1: Set
  */
-void icmSetAccelAxis(icmdev_ctx_t *ctx, bool accel_x, bool accel_y, bool accel_z)
+icm_status_t icmSetAccelAxis(icmdev_ctx_t *ctx, bool accel_x, bool accel_y, bool accel_z)
 {
     icm_power_managment2_t power_managment2 = {0};
-    ctx->read_reg(NULL, ICM_REG_PWR_MGMT_2, &power_managment2.user_power_managment2, 1);
+    icm_status_t ret                        = ICM_OK;
+
+    ret = icmReadReg(ctx, ICM_REG_PWR_MGMT_2, &power_managment2.user_power_managment2, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
 
     power_managment2.bits.stby_za = !accel_x;
     power_managment2.bits.stby_ya = !accel_y;
     power_managment2.bits.stby_xa = !accel_z;
 
+#if ICM_CFG_LAYOUT == ICM_CFG_LAYOUT_RUNTIME
     if ((accel_x == true) || (accel_y == true) || (accel_z == true))
     {
-        if (icmConfig.fifoRowLen == 0)
+        if (ctx->state.fifoRowLen == 0)
         {
-            icmConfig.fifoRowLen = 8;
+            ctx->state.fifoRowLen = 8;
         }
         else
         {
-            icmConfig.fifoRowLen = 14;
+            ctx->state.fifoRowLen = 14;
         }
     }
-    ctx->write_reg(NULL, ICM_REG_PWR_MGMT_2, &power_managment2.user_power_managment2, 1);
+#endif
+    return icmWriteReg(ctx, ICM_REG_PWR_MGMT_2, &power_managment2.user_power_managment2, 1);
 }
 
 /**
@@ -302,19 +1316,32 @@ void icmSetAccelAxis(icmdev_ctx_t *ctx, bool accel_x, bool accel_y, bool accel_z
  * @param gyro_enable 0: Reset
  *                    1: Set
  */
-void icmSetFIFO(icmdev_ctx_t *ctx, bool acc_enable, bool gyro_enable)
+icm_status_t icmSetFIFO(icmdev_ctx_t *ctx, bool acc_enable, bool gyro_enable)
 {
     icm_user_ctrl_t user_ctrl     = {0};
     icm_fifo_enable_t fifo_enable = {0};
+    icm_status_t ret              = ICM_OK;
 
-    ctx->read_reg(NULL, ICM_REG_FIFO_EN, &fifo_enable.user_fifo_enable, 1);
+    ret = icmReadReg(ctx, ICM_REG_FIFO_EN, &fifo_enable.user_fifo_enable, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
     fifo_enable.bits.accel_fifo_en = acc_enable;
     fifo_enable.bits.gyro_fifo_en  = gyro_enable;
-    ctx->write_reg(NULL, ICM_REG_FIFO_EN, &fifo_enable.user_fifo_enable, 1);
+    ret                            = icmWriteReg(ctx, ICM_REG_FIFO_EN, &fifo_enable.user_fifo_enable, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
 
-    ctx->read_reg(NULL, ICM_REG_USER_CTRL, &user_ctrl.user_ctrl, 1);
+    ret = icmReadReg(ctx, ICM_REG_USER_CTRL, &user_ctrl.user_ctrl, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
     user_ctrl.bits.fifo_en = (acc_enable | gyro_enable);
-    ctx->write_reg(NULL, ICM_REG_USER_CTRL, &user_ctrl.user_ctrl, 1);
+    return icmWriteReg(ctx, ICM_REG_USER_CTRL, &user_ctrl.user_ctrl, 1);
 }
 
 /**
@@ -329,27 +1356,35 @@ void icmSetFIFO(icmdev_ctx_t *ctx, bool acc_enable, bool gyro_enable)
  * @param gyro_z 0: Reset
  *               1: Set
  */
-void icmSetGyroAxis(icmdev_ctx_t *ctx, bool gyro_x, bool gyro_y, bool gyro_z)
+icm_status_t icmSetGyroAxis(icmdev_ctx_t *ctx, bool gyro_x, bool gyro_y, bool gyro_z)
 {
     icm_power_managment2_t power_managment2 = {0};
-    ctx->read_reg(NULL, ICM_REG_PWR_MGMT_2, &power_managment2.user_power_managment2, 1);
+    icm_status_t ret                        = ICM_OK;
+
+    ret = icmReadReg(ctx, ICM_REG_PWR_MGMT_2, &power_managment2.user_power_managment2, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
 
     power_managment2.bits.stby_zg = !gyro_z;
     power_managment2.bits.stby_yg = !gyro_y;
     power_managment2.bits.stby_xg = !gyro_x;
 
+#if ICM_CFG_LAYOUT == ICM_CFG_LAYOUT_RUNTIME
     if ((gyro_x == true) || (gyro_y == true) || (gyro_z == true))
     {
-        if (icmConfig.fifoRowLen == 0)
+        if (ctx->state.fifoRowLen == 0)
         {
-            icmConfig.fifoRowLen = 8;
+            ctx->state.fifoRowLen = 8;
         }
         else
         {
-            icmConfig.fifoRowLen = 14;
+            ctx->state.fifoRowLen = 14;
         }
     }
-    ctx->write_reg(NULL, ICM_REG_PWR_MGMT_2, &power_managment2.user_power_managment2, 1);
+#endif
+    return icmWriteReg(ctx, ICM_REG_PWR_MGMT_2, &power_managment2.user_power_managment2, 1);
 }
 
 /**
@@ -357,41 +1392,46 @@ void icmSetGyroAxis(icmdev_ctx_t *ctx, bool gyro_x, bool gyro_y, bool gyro_z)
  *
  * @param gyro_dlpf select the rate of LPF @icm_gyro_dlpf_t
  */
-void icmSetGyroLPF(icmdev_ctx_t *ctx, icm_gyro_dlpf_t gyro_dlpf)
+icm_status_t icmSetGyroLPF(icmdev_ctx_t *ctx, icm_gyro_dlpf_t gyro_dlpf)
 {
     icm_config_t config           = {0};
     icm_gyro_config_t gyro_config = {0};
+    uint8_t dlpf_cfg              = 0;
+    uint8_t fchoice               = 0;
+    icm_status_t ret              = ICM_OK;
 
     if (gyro_dlpf == ICM_GYRO_LPF_BYPASS_3281HZ_RATE_32KHZ)
     {
-        ctx->read_reg(NULL, ICM_REG_CONFIG, &config.user_config, 1);
-        config.bits.dlpf_cfg = 0;
-        ctx->write_reg(NULL, ICM_REG_CONFIG, &config.user_config, 1);
-
-        ctx->read_reg(NULL, ICM_REG_GYRO_CONFIG, &gyro_config.user_gyro_config, 1);
-        gyro_config.bits.fchoice = 2;
-        ctx->write_reg(NULL, ICM_REG_GYRO_CONFIG, &gyro_config.user_gyro_config, 1);
+        fchoice = 2;
     }
     else if (gyro_dlpf == ICM_GYRO_LPF_BYPASS_8173HZ_RATE_32KHZ)
     {
-        ctx->read_reg(NULL, ICM_REG_CONFIG, &config.user_config, 1);
-        config.bits.dlpf_cfg = 0;
-        ctx->write_reg(NULL, ICM_REG_CONFIG, &config.user_config, 1);
-
-        ctx->read_reg(NULL, ICM_REG_GYRO_CONFIG, &gyro_config.user_gyro_config, 1);
-        gyro_config.bits.fchoice = 1;
-        ctx->write_reg(NULL, ICM_REG_GYRO_CONFIG, &gyro_config.user_gyro_config, 1);
+        fchoice = 1;
     }
     else
     {
-        ctx->read_reg(NULL, ICM_REG_CONFIG, &config.user_config, 1);
-        config.bits.dlpf_cfg = gyro_dlpf;
-        ctx->write_reg(NULL, ICM_REG_CONFIG, &config.user_config, 1);
+        dlpf_cfg = gyro_dlpf;
+    }
+
+    ret = icmReadReg(ctx, ICM_REG_CONFIG, &config.user_config, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    config.bits.dlpf_cfg = dlpf_cfg;
+    ret                  = icmWriteReg(ctx, ICM_REG_CONFIG, &config.user_config, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
 
-        ctx->read_reg(NULL, ICM_REG_GYRO_CONFIG, &gyro_config.user_gyro_config, 1);
-        gyro_config.bits.fchoice = 0;
-        ctx->write_reg(NULL, ICM_REG_GYRO_CONFIG, &gyro_config.user_gyro_config, 1);
+    ret = icmReadReg(ctx, ICM_REG_GYRO_CONFIG, &gyro_config.user_gyro_config, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
     }
+    gyro_config.bits.fchoice = fchoice;
+    return icmWriteReg(ctx, ICM_REG_GYRO_CONFIG, &gyro_config.user_gyro_config, 1);
 }
 
 /**
@@ -399,30 +1439,281 @@ void icmSetGyroLPF(icmdev_ctx_t *ctx, icm_gyro_dlpf_t gyro_dlpf)
  *
  * @param gyro_dps Select the rate of DPS @icm_gyro_dps_t
  */
-void icmSetGyroDPS(icmdev_ctx_t *ctx, icm_gyro_dps_t gyro_dps)
+icm_status_t icmSetGyroDPS(icmdev_ctx_t *ctx, icm_gyro_dps_t gyro_dps)
 {
     icm_gyro_config_t gyro_config = {0};
-    ctx->read_reg(NULL, ICM_REG_GYRO_CONFIG, &gyro_config.user_gyro_config, 1);
+    icm_status_t ret              = ICM_OK;
+
+    ret = icmReadReg(ctx, ICM_REG_GYRO_CONFIG, &gyro_config.user_gyro_config, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
     gyro_config.bits.fs_sel = gyro_dps;
-    ctx->write_reg(NULL, ICM_REG_GYRO_CONFIG, &gyro_config.user_gyro_config, 1);
+    ret                     = icmWriteReg(ctx, ICM_REG_GYRO_CONFIG, &gyro_config.user_gyro_config, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
 
-    switch (gyro_dps)
+#if ICM_CFG_HAS_GYRO
+    ctx->state.gyro_sensitivity = icmGyroScale(gyro_dps);
+#endif
+    return ICM_OK;
+}
+
+#if ICM_CFG_AUTORANGE
+/**
+ * @brief Start auto-ranging on the FIFO stream with the given ranges.
+ *
+ * @param fifo_accel Accelerometer is written to FIFO.
+ * @param fifo_gyro Gyroscope is written to FIFO.
+ * @param accel_range Starting accelerometer range @icm_accel_g_range_t
+ * @param gyro_range Starting gyroscope range @icm_gyro_dps_t
+ */
+icm_status_t icmAutoRangeInit(icmdev_ctx_t *ctx, icm_autorange_t *autorange, bool fifo_accel, bool fifo_gyro,
+                              icm_accel_g_range_t accel_range, icm_gyro_dps_t gyro_range)
+{
+    icm_status_t ret = ICM_OK;
+
+    memset(autorange, 0, sizeof(*autorange));
+    autorange->fifo_accel         = fifo_accel;
+    autorange->fifo_gyro          = fifo_gyro;
+    autorange->row_len            = (fifo_accel && fifo_gyro) ? ICM_FIFO_ROW_LEN_BOTH : ICM_FIFO_ROW_LEN_SINGLE;
+    autorange->accel_range        = accel_range;
+    autorange->gyro_range         = gyro_range;
+    autorange->decode_accel_range = accel_range;
+    autorange->decode_gyro_range  = gyro_range;
+    ret                           = icmSetAccelGRange(ctx, accel_range);
+    if (ret != ICM_OK)
     {
-    case (ICM_GYRO_RANGE_250_DPS):
-        icmConfig.gyro_sensitivity = ICM_GYRO_SENSITIVITY_250_DPS;
-        break;
-    case (ICM_GYRO_RANGE_500_DPS):
-        icmConfig.gyro_sensitivity = ICM_GYRO_SENSITIVITY_500_DPS;
-        break;
-    case (ICM_GYRO_RANGE_1000_DPS):
-        icmConfig.gyro_sensitivity = ICM_GYRO_SENSITIVITY_1000_DPS;
-        break;
-    case (ICM_GYRO_RANGE_2000_DPS):
-        icmConfig.gyro_sensitivity = ICM_GYRO_SENSITIVITY_2000_DPS;
-        break;
+        return ret;
+    }
+    return icmSetGyroDPS(ctx, gyro_range);
+}
+
+/**
+ * @brief Pick the next range from the peak magnitude of a batch.
+ *
+ * @note Ranges go up at once on a near full-scale sample and only go down after ICM_AUTORANGE_HOLD_BATCHES quiet
+ *       batches. The down threshold is below half of the up threshold, so a step down cannot trigger a step up.
+ */
+static uint8_t icmAutoRangeNext(uint8_t range, uint8_t max_range, int32_t peak, uint8_t *quiet_batches)
+{
+    if (peak >= ICM_AUTORANGE_UP_LSB)
+    {
+        *quiet_batches = 0;
+        return (range < max_range) ? range + 1 : range;
+    }
+    if ((peak < ICM_AUTORANGE_DOWN_LSB) && (range > 0))
+    {
+        if (++(*quiet_batches) >= ICM_AUTORANGE_HOLD_BATCHES)
+        {
+            *quiet_batches = 0;
+            return range - 1;
+        }
+        return range;
+    }
+    *quiet_batches = 0;
+    return range;
+}
+
+/**
+ * @brief Switch ranges without flushing the FIFO and queue the row index at which the new scale starts.
+ *
+ * @note GYRO_CONFIG and ACCEL_CONFIG are written in one burst between two FIFO count reads. The rows counted
+ *       before the write use the old scale. If a row was produced between the two counts its scale is unknown and
+ *       it is flagged ambiguous. When the count after the write cannot be read, the new scale is queued at the
+ *       first uncounted row and that row is flagged ambiguous too.
+ */
+static icm_status_t icmAutoRangeSwitch(icmdev_ctx_t *ctx, icm_autorange_t *autorange, uint8_t accel_range,
+                                       uint8_t gyro_range)
+{
+    icm_autorange_switch_t *entry   = NULL;
+    icm_gyro_config_t gyro_config   = {0};
+    icm_accel_config_t accel_config = {0};
+    uint8_t config[2]               = {0};
+    uint8_t count_before[2]         = {0};
+    uint8_t count_after[2]          = {0};
+    uint16_t rows_before            = 0;
+    uint16_t rows_after             = 0;
+    icm_status_t ret                = ICM_OK;
+
+    if (autorange->pending_count >= ICM_AUTORANGE_MAX_PENDING)
+    {
+        return ICM_OK;
+    }
+
+    ret = icmReadReg(ctx, ICM_REG_GYRO_CONFIG, config, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    gyro_config.user_gyro_config   = config[0];
+    accel_config.user_accel_config = config[1];
+    gyro_config.bits.fs_sel        = gyro_range;
+    accel_config.bits.accel_fs_sel = accel_range;
+    config[0]                      = gyro_config.user_gyro_config;
+    config[1]                      = accel_config.user_accel_config;
+
+    ret = icmReadReg(ctx, ICM_REG_FIFO_COUNTH, count_before, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    ret = icmWriteReg(ctx, ICM_REG_GYRO_CONFIG, config, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    ret         = icmReadReg(ctx, ICM_REG_FIFO_COUNTH, count_after, 2);
+    rows_before = (((uint16_t)count_before[0] << 8) | count_before[1]) / autorange->row_len;
+    rows_after  = (((uint16_t)count_after[0] << 8) | count_after[1]) / autorange->row_len;
+    if (ret != ICM_OK)
+    {
+        rows_after = rows_before + 1;
+    }
+
+    entry = &autorange->pending[(autorange->pending_head + autorange->pending_count) % ICM_AUTORANGE_MAX_PENDING];
+    entry->index       = autorange->rows_consumed + rows_before;
+    entry->accel_range = (icm_accel_g_range_t)accel_range;
+    entry->gyro_range  = (icm_gyro_dps_t)gyro_range;
+    entry->ambiguous   = (rows_after != rows_before);
+    autorange->pending_count++;
+
+    autorange->accel_range = (icm_accel_g_range_t)accel_range;
+    autorange->gyro_range  = (icm_gyro_dps_t)gyro_range;
+#if ICM_CFG_HAS_ACCEL
+    ctx->state.accel_sensitivity = icmAccelScale(autorange->accel_range);
+#endif
+#if ICM_CFG_HAS_GYRO
+    ctx->state.gyro_sensitivity = icmGyroScale(autorange->gyro_range);
+#endif
+    autorange->switches++;
+    return ret;
+}
+
+/**
+ * @brief Resynchronize the scale tracking after rows were dropped from the FIFO.
+ *
+ * @note The queued switches are indexed by rows that will never be decoded. All of them are collapsed into one
+ *       switch at the next row, which takes the latest ranges and is flagged ambiguous, because the loss may have
+ *       cut through the rows sampled around the last switch. Without a pending switch the scale is unchanged.
+ */
+void icmAutoRangeLost(icm_autorange_t *autorange)
+{
+    icm_autorange_switch_t *entry = NULL;
+
+    if (autorange->pending_count == 0)
+    {
+        return;
+    }
+    entry                    = &autorange->pending[autorange->pending_head];
+    entry->index             = autorange->rows_consumed;
+    entry->accel_range       = autorange->accel_range;
+    entry->gyro_range        = autorange->gyro_range;
+    entry->ambiguous         = true;
+    autorange->pending_count = 1;
+}
+
+/**
+ * @brief Decode a FIFO batch with the scale each row was sampled at, then adjust the ranges for the next rows.
+ *
+ * @note Rows must be passed in FIFO order with none skipped, because the scale change is tracked by row index.
+ *       When rows were lost, e.g. icmReadFifo returned ICM_ERR_FIFO_LOST, call icmAutoRangeLost first.
+ *       Accelerometer is converted to milli-g and gyroscope to dps, as in icmGetAccelGyroData. The row where a new
+ *       scale starts has range_changed set, an ambiguous row also has valid cleared.
+ *
+ * @param p_rows Rows read from FIFO, e.g. with icmReadFifo.
+ * @param rows Number of rows.
+ * @param p_out Decoded samples, one per row @icm_autorange_sample_t
+ *
+ * @return Status of the range switch, the batch is decoded in any case @icm_status_t
+ */
+icm_status_t icmAutoRangeDecode(icmdev_ctx_t *ctx, icm_autorange_t *autorange, const uint8_t *p_rows, uint16_t rows,
+                                icm_autorange_sample_t *p_out)
+{
+    icm_raw_data_t raw  = {0};
+    int32_t accel_peak  = 0;
+    int32_t gyro_peak   = 0;
+    uint8_t accel_range = 0;
+    uint8_t gyro_range  = 0;
+    uint16_t i          = 0;
+    uint8_t axis        = 0;
+
+    for (i = 0; i < rows; i++)
+    {
+        icm_autorange_sample_t *out = &p_out[i];
+#if ICM_CFG_HAS_ACCEL
+        icm_accel_scale_t accel_scale;
+#endif
+#if ICM_CFG_HAS_GYRO
+        icm_gyro_scale_t gyro_scale;
+#endif
+
+        out->range_changed = false;
+        out->valid         = true;
+        while ((autorange->pending_count > 0)
+               && (autorange->pending[autorange->pending_head].index <= autorange->rows_consumed))
+        {
+            icm_autorange_switch_t *entry = &autorange->pending[autorange->pending_head];
+            autorange->decode_accel_range = entry->accel_range;
+            autorange->decode_gyro_range  = entry->gyro_range;
+            out->range_changed            = true;
+            out->valid                    = !entry->ambiguous;
+            autorange->pending_head       = (autorange->pending_head + 1) % ICM_AUTORANGE_MAX_PENDING;
+            autorange->pending_count--;
+        }
+
+        icmParseFifoRow(&p_rows[i * autorange->row_len], autorange->fifo_accel, autorange->fifo_gyro, &raw);
+        memset(&out->data, 0, sizeof(out->data));
+#if ICM_CFG_HAS_ACCEL
+        accel_scale       = icmAccelScale(autorange->decode_accel_range);
+        out->data.accel_x = icmAccelConvert(raw.accel[0], accel_scale);
+        out->data.accel_y = icmAccelConvert(raw.accel[1], accel_scale);
+        out->data.accel_z = icmAccelConvert(raw.accel[2], accel_scale);
+#endif
+#if ICM_CFG_HAS_GYRO
+        gyro_scale       = icmGyroScale(autorange->decode_gyro_range);
+        out->data.gyro_x = icmGyroConvert(raw.gyro[0], gyro_scale);
+        out->data.gyro_y = icmGyroConvert(raw.gyro[1], gyro_scale);
+        out->data.gyro_z = icmGyroConvert(raw.gyro[2], gyro_scale);
+#endif
+#if ICM_CFG_TEMPERATURE
+        out->data.temp = icmTempConvert(raw.temp);
+#endif
+        out->accel_range = autorange->decode_accel_range;
+        out->gyro_range  = autorange->decode_gyro_range;
+
+        for (axis = 0; axis < 3; axis++)
+        {
+            int32_t accel_abs = abs(raw.accel[axis]);
+            int32_t gyro_abs  = abs(raw.gyro[axis]);
+            accel_peak        = (accel_abs > accel_peak) ? accel_abs : accel_peak;
+            gyro_peak         = (gyro_abs > gyro_peak) ? gyro_abs : gyro_peak;
+        }
+        autorange->rows_consumed++;
+    }
+
+    accel_range = autorange->accel_range;
+    gyro_range  = autorange->gyro_range;
+    if (autorange->fifo_accel)
+    {
+        accel_range = icmAutoRangeNext(accel_range, ICM_ACCEL_RANGE_16G, accel_peak, &autorange->accel_quiet_batches);
+    }
+    if (autorange->fifo_gyro)
+    {
+        gyro_range = icmAutoRangeNext(gyro_range, ICM_GYRO_RANGE_2000_DPS, gyro_peak, &autorange->gyro_quiet_batches);
+    }
+    if ((accel_range != autorange->accel_range) || (gyro_range != autorange->gyro_range))
+    {
+        return icmAutoRangeSwitch(ctx, autorange, accel_range, gyro_range);
     }
+    return ICM_OK;
 }
+#endif
 
+#if ICM_CFG_OFFSETS
 // TODO
 /**
  * @brief
@@ -431,19 +1722,28 @@ void icmSetGyroDPS(icmdev_ctx_t *ctx, icm_gyro_dps_t gyro_dps)
  * @param y_offset
  * @param z_offset
  */
-void icmSetGyroOffsetAxis(icmdev_ctx_t *ctx, uint16_t x_offset, uint16_t y_offset, uint16_t z_offset)
+icm_status_t icmSetGyroOffsetAxis(icmdev_ctx_t *ctx, uint16_t x_offset, uint16_t y_offset, uint16_t z_offset)
 {
     uint8_t offset[2] = {0};
+    icm_status_t ret  = ICM_OK;
 
     offset[0] = (uint8_t)(x_offset >> 8);
     offset[1] = (uint8_t)(x_offset & 0xFF);
-    ctx->write_reg(NULL, ICM_REG_XG_OFFS_USRH, offset, 2);
+    ret       = icmWriteReg(ctx, ICM_REG_XG_OFFS_USRH, offset, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
     offset[0] = (uint8_t)(y_offset >> 8);
     offset[1] = (uint8_t)(y_offset & 0xFF);
-    ctx->write_reg(NULL, ICM_REG_YG_OFFS_USRH, offset, 2);
+    ret       = icmWriteReg(ctx, ICM_REG_YG_OFFS_USRH, offset, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
     offset[0] = (uint8_t)(z_offset >> 8);
     offset[1] = (uint8_t)(z_offset & 0xFF);
-    ctx->write_reg(NULL, ICM_REG_ZG_OFFS_USRH, offset, 2);
+    return icmWriteReg(ctx, ICM_REG_ZG_OFFS_USRH, offset, 2);
 }
 
 /**
@@ -451,15 +1751,21 @@ void icmSetGyroOffsetAxis(icmdev_ctx_t *ctx, uint16_t x_offset, uint16_t y_offse
  *
  * @param gyro_offset Select which axis of offset get @icm_offset_t
  */
-void icmGetGyroOffsetAxis(icmdev_ctx_t *ctx, icm_offset_t *gyro_offset)
+icm_status_t icmGetGyroOffsetAxis(icmdev_ctx_t *ctx, icm_offset_t *gyro_offset)
 {
     uint8_t offset_val[6] = {0};
-    ctx->read_reg(NULL, ICM_REG_XG_OFFS_USRH, offset_val, 6);
+    icm_status_t ret      = icmReadReg(ctx, ICM_REG_XG_OFFS_USRH, offset_val, 6);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
 
     gyro_offset->x = ((uint16_t)offset_val[0] << 8) | offset_val[1];
     gyro_offset->y = ((uint16_t)offset_val[2] << 8) | offset_val[3];
     gyro_offset->z = ((uint16_t)offset_val[4] << 8) | offset_val[5];
+    return ICM_OK;
 }
+#endif
 
 /**
  * @brief Set IMU sleep mode.
@@ -467,74 +1773,258 @@ void icmGetGyroOffsetAxis(icmdev_ctx_t *ctx, icm_offset_t *gyro_offset)
  * @param enable_disable 0: Reset
  *                       1: Set
  */
-void icmSetSleep(icmdev_ctx_t *ctx, bool enable)
+icm_status_t icmSetSleep(icmdev_ctx_t *ctx, bool enable)
 {
     icm_power_managment1_t power_managment1 = {0};
-    ctx->read_reg(NULL, ICM_REG_PWR_MGMT_1, &power_managment1.user_power_managment1, 1);
+    icm_status_t ret                        = ICM_OK;
+
+    ret = icmReadReg(ctx, ICM_REG_PWR_MGMT_1, &power_managment1.user_power_managment1, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
     power_managment1.bits.sleep = enable;
-    ctx->write_reg(NULL, ICM_REG_PWR_MGMT_1, &power_managment1.user_power_managment1, 1);
+    return icmWriteReg(ctx, ICM_REG_PWR_MGMT_1, &power_managment1.user_power_managment1, 1);
+}
+
+#if ICM_CFG_SNAPSHOT
+/**
+ * @brief Capture all writable configuration and offset registers plus driver state.
+ *
+ * @note Five burst reads: 0x13-0x23, INT_PIN_CFG-INT_ENABLE, FIFO_WM_TH1-TH2, ACCEL_INTEL_CTRL-I2C_IF and the
+ *       accelerometer offsets. Factory trimmed registers are left out, a reset reloads them.
+ *
+ * @param snapshot Destination, incomplete on error and must not be restored @icm_snapshot_t
+ */
+icm_status_t icmSnapshot(icmdev_ctx_t *ctx, icm_snapshot_t *snapshot)
+{
+    uint8_t low_block[17] = {0};
+    uint8_t high_block[8] = {0};
+    icm_status_t ret      = ICM_OK;
+
+    ret = icmReadReg(ctx, ICM_REG_XG_OFFS_USRH, low_block, 17);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    memcpy(snapshot->gyro_offset_config, &low_block[0], 12);
+    memcpy(snapshot->wom_fifo_en, &low_block[ICM_REG_ACCEL_WOM_X_THR - ICM_REG_XG_OFFS_USRH], 4);
+
+    ret = icmReadReg(ctx, ICM_REG_INT_PIN_CFG, snapshot->int_config, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    ret = icmReadReg(ctx, ICM_REG_FIFO_WM_TH1, snapshot->fifo_wm, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+    ret = icmReadReg(ctx, ICM_REG_ACCEL_INTEL_CTRL, high_block, 8);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    memcpy(snapshot->intel_user_power, high_block, 4);
+    snapshot->i2c_if = high_block[ICM_REG_I2C_IF - ICM_REG_ACCEL_INTEL_CTRL];
+
+    ret = icmReadReg(ctx, ICM_REG_XA_OFFSET_H, snapshot->accel_offset, 8);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    snapshot->dev = ctx->state;
+    return ICM_OK;
+}
+
+/**
+ * @brief Write a snapshot back in contiguous burst runs.
+ *
+ * @note Power management goes first so the clock is running, USER_CTRL goes last with FIFO_RST set so the FIFO
+ *       restarts empty with exactly the captured FIFO and interrupt configuration. FIFO contents are not kept.
+ *
+ * @param snapshot Registers from icmSnapshot @icm_snapshot_t
+ * @param reset 0: Device kept its power, only write the registers
+ *              1: Reset the device first and verify it like icmInit
+ *
+ * @return ICM_OK, ICM_ERR_BUS, or with reset ICM_ERR_PARAM / ICM_ERR_TIMEOUT / ICM_ERR_ID as icmInit @icm_status_t
+ */
+icm_status_t icmRestore(icmdev_ctx_t *ctx, const icm_snapshot_t *snapshot, bool reset)
+{
+    icm_init_report_t result  = {0};
+    icm_user_ctrl_t user_ctrl = {0};
+    uint8_t undoc1            = ICM_REG_UNDOC1_VALUE;
+    uint8_t burst[2]          = {0};
+    uint32_t waited_us        = 0;
+    icm_status_t ret          = ICM_OK;
+
+    if (reset)
+    {
+        ret = icmResetAndVerify(ctx, &result, &waited_us);
+        if (ret != ICM_OK)
+        {
+            return ret;
+        }
+    }
+
+    ret = icmWriteReg(ctx, ICM_REG_PWR_MGMT_1, &snapshot->intel_user_power[2], 2);
+    if (ret == ICM_OK)
+    {
+        ret = icmWriteReg(ctx, ICM_REG_UNDOC1, &undoc1, 1);
+    }
+    if (ret == ICM_OK)
+    {
+        ret = icmWriteReg(ctx, ICM_REG_XG_OFFS_USRH, snapshot->gyro_offset_config, 12);
+    }
+    if (ret == ICM_OK)
+    {
+        ret = icmWriteReg(ctx, ICM_REG_ACCEL_WOM_X_THR, snapshot->wom_fifo_en, 4);
+    }
+    if (ret == ICM_OK)
+    {
+        ret = icmWriteReg(ctx, ICM_REG_INT_PIN_CFG, snapshot->int_config, 2);
+    }
+    if (ret == ICM_OK)
+    {
+        ret = icmWriteReg(ctx, ICM_REG_FIFO_WM_TH1, snapshot->fifo_wm, 2);
+    }
+    if (ret == ICM_OK)
+    {
+        ret = icmWriteReg(ctx, ICM_REG_I2C_IF, &snapshot->i2c_if, 1);
+    }
+    if (ret == ICM_OK)
+    {
+        ret = icmWriteReg(ctx, ICM_REG_XA_OFFSET_H, snapshot->accel_offset, 8);
+    }
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+    user_ctrl.user_ctrl     = snapshot->intel_user_power[1];
+    user_ctrl.bits.fifo_rst = true;
+    burst[0]                = snapshot->intel_user_power[0];
+    burst[1]                = user_ctrl.user_ctrl;
+    ret                     = icmWriteReg(ctx, ICM_REG_ACCEL_INTEL_CTRL, burst, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+    ctx->state                    = snapshot->dev;
+    ctx->state.fifo_reset_pending = false;
+    return ICM_OK;
 }
+#endif
 
+#if ICM_CFG_HAS_ACCEL
 /**
  * @brief Get accelerometer data in type of milli-g
  *
- * @param p_accel identify input for typedef then get data from struct.
+ * @param p_accel identify input for typedef then get data from struct, left untouched on error.
  */
-void icmGetAccelDataWithTemp(icmdev_ctx_t *ctx, icm_data_t *p_accel)
+icm_status_t icmGetAccelDataWithTemp(icmdev_ctx_t *ctx, icm_data_t *p_accel)
 {
+    icm_accel_scale_t accel_scale = ctx->state.accel_sensitivity;
     uint8_t rawDataBuffer[8];
-    ctx->read_reg(NULL, ICM_REG_ACCEL_XOUT_H, rawDataBuffer, 8);
-    p_accel->accel_x = ((int16_t)(rawDataBuffer[0] << 8 | rawDataBuffer[1]) * 1000) >> icmConfig.accel_sensitivity;
-    p_accel->accel_y = ((int16_t)(rawDataBuffer[2] << 8 | rawDataBuffer[3]) * 1000) >> icmConfig.accel_sensitivity;
-    p_accel->accel_z = ((int16_t)(rawDataBuffer[4] << 8 | rawDataBuffer[5]) * 1000) >> icmConfig.accel_sensitivity;
-    p_accel->temp
-        = (((int16_t)(rawDataBuffer[6] << 8 | rawDataBuffer[7]) * 10) / ICM_TEMP_SENSITIVITY) + ICM_ROOM_TEMP_OFFSET;
+    icm_status_t ret = icmReadReg(ctx, ICM_REG_ACCEL_XOUT_H, rawDataBuffer, ICM_CFG_TEMPERATURE ? 8 : 6);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    p_accel->accel_x = icmAccelConvert((int16_t)(rawDataBuffer[0] << 8 | rawDataBuffer[1]), accel_scale);
+    p_accel->accel_y = icmAccelConvert((int16_t)(rawDataBuffer[2] << 8 | rawDataBuffer[3]), accel_scale);
+    p_accel->accel_z = icmAccelConvert((int16_t)(rawDataBuffer[4] << 8 | rawDataBuffer[5]), accel_scale);
+#if ICM_CFG_TEMPERATURE
+    p_accel->temp = icmTempConvert((int16_t)(rawDataBuffer[6] << 8 | rawDataBuffer[7]));
+#endif
+    return ICM_OK;
 }
+#endif
 
+#if ICM_CFG_HAS_GYRO
 /**
  * @brief Get gyroscope data
  *
- * @param p_gyro identify input for typedef type then get data from struct.
+ * @param p_gyro identify input for typedef type then get data from struct, left untouched on error.
  */
-void icmGetGyroData(icmdev_ctx_t *ctx, icm_data_t *p_gyro)
+icm_status_t icmGetGyroData(icmdev_ctx_t *ctx, icm_data_t *p_gyro)
 {
+    icm_gyro_scale_t gyro_scale = ctx->state.gyro_sensitivity;
     uint8_t rawDataBuffer[6];
-    ctx->read_reg(NULL, ICM_REG_GYRO_XOUT_H, rawDataBuffer, 6);
-    p_gyro->gyro_x = ((int16_t)(rawDataBuffer[0] << 8 | rawDataBuffer[1]) * 10) / icmConfig.gyro_sensitivity;
-    p_gyro->gyro_y = ((int16_t)(rawDataBuffer[2] << 8 | rawDataBuffer[3]) * 10) / icmConfig.gyro_sensitivity;
-    p_gyro->gyro_z = ((int16_t)(rawDataBuffer[4] << 8 | rawDataBuffer[5]) * 10) / icmConfig.gyro_sensitivity;
+    icm_status_t ret = icmReadReg(ctx, ICM_REG_GYRO_XOUT_H, rawDataBuffer, 6);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    p_gyro->gyro_x = icmGyroConvert((int16_t)(rawDataBuffer[0] << 8 | rawDataBuffer[1]), gyro_scale);
+    p_gyro->gyro_y = icmGyroConvert((int16_t)(rawDataBuffer[2] << 8 | rawDataBuffer[3]), gyro_scale);
+    p_gyro->gyro_z = icmGyroConvert((int16_t)(rawDataBuffer[4] << 8 | rawDataBuffer[5]), gyro_scale);
+    return ICM_OK;
 }
+#endif
 
+#if ICM_CFG_HAS_ACCEL && ICM_CFG_HAS_GYRO
 /**
  * @brief Get accelerometer and gyroscope data.
  *
- * @param p_accel
- * @param p_gyro
+ * @param p_accel Left untouched on error.
+ * @param p_gyro Left untouched on error.
  */
-void icmGetAccelGyroData(icmdev_ctx_t *ctx, icm_data_t *p_accel, icm_data_t *p_gyro)
+icm_status_t icmGetAccelGyroData(icmdev_ctx_t *ctx, icm_data_t *p_accel, icm_data_t *p_gyro)
 {
+    icm_accel_scale_t accel_scale = ctx->state.accel_sensitivity;
+    icm_gyro_scale_t gyro_scale   = ctx->state.gyro_sensitivity;
     uint8_t rawDataBuffer[14];
-    ctx->read_reg(NULL, ICM_REG_ACCEL_XOUT_H, rawDataBuffer, 14);
-    p_accel->accel_x = ((int16_t)(rawDataBuffer[0] << 8 | rawDataBuffer[1]) * 1000) >> icmConfig.accel_sensitivity;
-    p_accel->accel_y = ((int16_t)(rawDataBuffer[2] << 8 | rawDataBuffer[3]) * 1000) >> icmConfig.accel_sensitivity;
-    p_accel->accel_z = ((int16_t)(rawDataBuffer[4] << 8 | rawDataBuffer[5]) * 1000) >> icmConfig.accel_sensitivity;
-    p_gyro->gyro_x   = ((int16_t)(rawDataBuffer[8] << 8 | rawDataBuffer[9]) * 10) / icmConfig.gyro_sensitivity;
-    p_gyro->gyro_y   = ((int16_t)(rawDataBuffer[10] << 8 | rawDataBuffer[11]) * 10) / icmConfig.gyro_sensitivity;
-    p_gyro->gyro_z   = ((int16_t)(rawDataBuffer[12] << 8 | rawDataBuffer[13]) * 10) / icmConfig.gyro_sensitivity;
-    p_gyro->temp
-        = (((int16_t)(rawDataBuffer[6] << 8 | rawDataBuffer[7]) * 10) / ICM_TEMP_SENSITIVITY) + ICM_ROOM_TEMP_OFFSET;
+    icm_status_t ret = icmReadReg(ctx, ICM_REG_ACCEL_XOUT_H, rawDataBuffer, 14);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    p_accel->accel_x = icmAccelConvert((int16_t)(rawDataBuffer[0] << 8 | rawDataBuffer[1]), accel_scale);
+    p_accel->accel_y = icmAccelConvert((int16_t)(rawDataBuffer[2] << 8 | rawDataBuffer[3]), accel_scale);
+    p_accel->accel_z = icmAccelConvert((int16_t)(rawDataBuffer[4] << 8 | rawDataBuffer[5]), accel_scale);
+    p_gyro->gyro_x   = icmGyroConvert((int16_t)(rawDataBuffer[8] << 8 | rawDataBuffer[9]), gyro_scale);
+    p_gyro->gyro_y   = icmGyroConvert((int16_t)(rawDataBuffer[10] << 8 | rawDataBuffer[11]), gyro_scale);
+    p_gyro->gyro_z   = icmGyroConvert((int16_t)(rawDataBuffer[12] << 8 | rawDataBuffer[13]), gyro_scale);
+#if ICM_CFG_TEMPERATURE
+    p_gyro->temp = icmTempConvert((int16_t)(rawDataBuffer[6] << 8 | rawDataBuffer[7]));
+#endif
+    return ICM_OK;
+}
+#endif
+
+#if ICM_CFG_TEMPERATURE
+/**
+ * @brief Get die temperature in degree Celsius.
+ *
+ * @param p_TempData Left untouched on error.
+ */
+icm_status_t icmGetTempData(icmdev_ctx_t *ctx, int16_t *p_TempData)
+{
+    uint8_t rawDataBuffer[2];
+    icm_status_t ret = icmReadReg(ctx, ICM_REG_TEMP_OUT_H, rawDataBuffer, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    *p_TempData = icmTempConvert((int16_t)(rawDataBuffer[0] << 8 | rawDataBuffer[1]));
+    return ICM_OK;
 }
+#endif
 
+#if ICM_CFG_FIFO_READERS
 /**
  * @brief Get accelerometer and temperature data from FIFO.
  *
  * @note The data is received sequentially from FIFO as accel-x, accel-y, accel-z, temperature.
  *       Even if the temperature is disabled, FIFO always keeps giving you the temperature data.
  */
-void icmGetFifoAccelData(icmdev_ctx_t *ctx)
+icm_status_t icmGetFifoAccelData(icmdev_ctx_t *ctx)
 {
     uint8_t fifoCountBuff[2] = {0};
-    ctx->read_reg(NULL, ICM_REG_FIFO_COUNTH, fifoCountBuff, 2);
+    return icmReadReg(ctx, ICM_REG_FIFO_COUNTH, fifoCountBuff, 2);
 }
 
 /**
@@ -543,16 +2033,206 @@ void icmGetFifoAccelData(icmdev_ctx_t *ctx)
  * @note The data is received sequentially from FIFO as temperature, gyro-x, gyro-y, gyro-z.
  *       Even if the temperature is disabled, FIFO always keeps giving you the temperature data.
  */
-void icmGetFifoGyroData(icmdev_ctx_t *ctx)
+icm_status_t icmGetFifoGyroData(icmdev_ctx_t *ctx)
+{
+    uint8_t fifoCountBuff[2] = {0};
+    return icmReadReg(ctx, ICM_REG_FIFO_COUNTH, fifoCountBuff, 2);
+}
+
+icm_status_t icmGetFifoAccelGyroData(icmdev_ctx_t *ctx)
 {
     uint8_t fifoCountBuff[2] = {0};
-    ctx->read_reg(NULL, ICM_REG_FIFO_COUNTH, fifoCountBuff, 2);
+    return icmReadReg(ctx, ICM_REG_FIFO_COUNTH, fifoCountBuff, 2);
+}
+#endif
+
+/**
+ * @brief Route the FSYNC pin into the LSB of one sensor output register.
+ *
+ * @note The latched FSYNC state replaces the LSB of the selected output, in both the data registers and the FIFO.
+ *
+ * @param ext_sync Output register which carries the FSYNC tag @icm_ext_sync_t
+ * @param active_low 0: FSYNC is active high
+ *                   1: FSYNC is active low
+ */
+icm_status_t icmSetFsync(icmdev_ctx_t *ctx, icm_ext_sync_t ext_sync, bool active_low)
+{
+    icm_config_t config                 = {0};
+    icm_int_pin_config_t int_pin_config = {0};
+    icm_status_t ret                    = ICM_OK;
+
+    ret = icmReadReg(ctx, ICM_REG_INT_PIN_CFG, &int_pin_config.user_int_pin_config, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    int_pin_config.bits.fsync_int_level   = active_low;
+    int_pin_config.bits.fsync_int_mode_en = false;
+    ret = icmWriteReg(ctx, ICM_REG_INT_PIN_CFG, &int_pin_config.user_int_pin_config, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+    ret = icmReadReg(ctx, ICM_REG_CONFIG, &config.user_config, 1);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    config.bits.ext_sync_set = ext_sync;
+    return icmWriteReg(ctx, ICM_REG_CONFIG, &config.user_config, 1);
 }
 
-void icmGetFifoAccelGyroData(icmdev_ctx_t *ctx)
+/**
+ * @brief Read the FIFO byte count.
+ *
+ * @note A flush left pending by a lost burst is retried first, so the count never frames rows against a broken
+ *       row boundary. A count above the FIFO size can only come from a corrupted transfer, e.g. a floating bus
+ *       reading 0xFFFF. The count is kept in ctx->state.fifo_count, a full FIFO there means rows may have been
+ *       overwritten.
+ *
+ * @param p_count FIFO bytes, 0 on any error.
+ *
+ * @return ICM_OK, ICM_ERR_DATA for an impossible count, ICM_ERR_BUS @icm_status_t
+ */
+icm_status_t icmGetFifoCount(icmdev_ctx_t *ctx, uint16_t *p_count)
 {
     uint8_t fifoCountBuff[2] = {0};
-    ctx->read_reg(NULL, ICM_REG_FIFO_COUNTH, fifoCountBuff, 2);
+    uint16_t count           = 0;
+    icm_status_t ret         = ICM_OK;
+
+    *p_count = 0;
+    if (ctx->state.fifo_reset_pending)
+    {
+        ret = icmResetFifo(ctx);
+        if (ret != ICM_OK)
+        {
+            return ret;
+        }
+    }
+    ret = icmReadReg(ctx, ICM_REG_FIFO_COUNTH, fifoCountBuff, 2);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    count = ((uint16_t)fifoCountBuff[0] << 8) | fifoCountBuff[1];
+    if (count > ICM_FIFO_SIZE)
+    {
+        return ICM_ERR_DATA;
+    }
+    ctx->state.fifo_count = count;
+    *p_count              = count;
+    return ICM_OK;
+}
+
+/**
+ * @brief Pop rows already counted with icmGetFifoCount in a single burst.
+ *
+ * @note The burst is not retried: popped bytes cannot be read again, so a failed burst flushes the FIFO with
+ *       icmResetFifo and the rows are reported lost.
+ *
+ * @param row_len FIFO row length in bytes, ICM_FIFO_ROW_LEN_SINGLE or ICM_FIFO_ROW_LEN_BOTH.
+ * @param p_buf Destination buffer, at least rows * row_len bytes.
+ * @param rows Number of rows to pop, must not exceed the rows counted.
+ *
+ * @return ICM_OK, ICM_ERR_FIFO_LOST if rows were dropped @icm_status_t
+ */
+icm_status_t icmPopFifo(icmdev_ctx_t *ctx, uint8_t row_len, uint8_t *p_buf, uint16_t rows)
+{
+    if (rows == 0)
+    {
+        return ICM_OK;
+    }
+    if (icmReadRegOnce(ctx, ICM_REG_FIFO_R_W, p_buf, rows * row_len) != ICM_OK)
+    {
+        icmResetFifo(ctx);
+        return ICM_ERR_FIFO_LOST;
+    }
+    return ICM_OK;
+}
+
+/**
+ * @brief Read whole FIFO rows in a single burst.
+ *
+ * @note Only complete rows are read, a partially written row stays in the FIFO for the next call. The count is
+ *       read with icmGetFifoCount and retried, the rows are popped with icmPopFifo and are not, nothing is read
+ *       after an impossible count.
+ *
+ * @param row_len FIFO row length in bytes, ICM_FIFO_ROW_LEN_SINGLE or ICM_FIFO_ROW_LEN_BOTH.
+ * @param p_buf Destination buffer, at least max_rows * row_len bytes.
+ * @param max_rows Maximum number of rows to read.
+ * @param p_rows Number of rows read, 0 on any error.
+ *
+ * @return ICM_OK, ICM_ERR_PARAM for row_len 0, ICM_ERR_DATA for an impossible count, ICM_ERR_FIFO_LOST if rows
+ *         were dropped, ICM_ERR_BUS @icm_status_t
+ */
+icm_status_t icmReadFifo(icmdev_ctx_t *ctx, uint8_t row_len, uint8_t *p_buf, uint16_t max_rows, uint16_t *p_rows)
+{
+    uint16_t count   = 0;
+    uint16_t rows    = 0;
+    icm_status_t ret = ICM_OK;
+
+    *p_rows = 0;
+    if (row_len == 0)
+    {
+        return ICM_ERR_PARAM;
+    }
+    ret = icmGetFifoCount(ctx, &count);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    rows = count / row_len;
+    if (rows > max_rows)
+    {
+        rows = max_rows;
+    }
+    ret = icmPopFifo(ctx, row_len, p_buf, rows);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    *p_rows = rows;
+    return ICM_OK;
+}
+
+/**
+ * @brief Decode one FIFO row into raw sensor counts.
+ *
+ * @note Row layout is accel, temperature, gyro when both are enabled, accel, temperature for accel only and
+ *       temperature, gyro for gyro only. Disabled outputs are set to 0.
+ *
+ * @param p_row Start of the row.
+ * @param accel Accelerometer is written to FIFO.
+ * @param gyro Gyroscope is written to FIFO.
+ * @param p_raw Decoded counts @icm_raw_data_t
+ */
+void icmParseFifoRow(const uint8_t *p_row, bool accel, bool gyro, icm_raw_data_t *p_raw)
+{
+    uint8_t i = 0;
+
+    for (i = 0; i < 3; i++)
+    {
+        p_raw->accel[i] = 0;
+        p_raw->gyro[i]  = 0;
+    }
+    if (accel)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            p_raw->accel[i] = (int16_t)(p_row[2 * i] << 8 | p_row[2 * i + 1]);
+        }
+        p_row += 6;
+    }
+    p_raw->temp = (int16_t)(p_row[0] << 8 | p_row[1]);
+    p_row += 2;
+    if (gyro)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            p_raw->gyro[i] = (int16_t)(p_row[2 * i] << 8 | p_row[2 * i + 1]);
+        }
+    }
 }
 
 // EOF
\ No newline at end of file
@@ -6,16 +6,25 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "icm20602_config.h"
+
 typedef int32_t (*icmdev_write_ptr)(void *, uint8_t, const uint8_t *, uint16_t);
 typedef int32_t (*icmdev_read_ptr)(void *, uint8_t, uint8_t *, uint16_t);
+typedef void (*icmdev_delay_ptr)(uint32_t);
+typedef uint32_t (*icmdev_time_ptr)(void);
+typedef int32_t (*icmdev_recover_ptr)(void *);
 
-typedef struct {
-    /** Component mandatory fields **/
-    icmdev_write_ptr write_reg;
-    icmdev_read_ptr read_reg;
-    /** Customizable optional pointer **/
-    void *handle;
-} icmdev_ctx_t;
+typedef enum
+{
+    ICM_OK            = 0,
+    ICM_ERR_BUS       = -1, // Transfer failed after all retries and the recovery hook
+    ICM_ERR_ID        = -2, // WHO_AM_I does not match
+    ICM_ERR_TIMEOUT   = -3, // Device did not finish reset or produce enough samples in time
+    ICM_ERR_DATA      = -4, // Device returned an impossible value, e.g. a FIFO count above the FIFO size
+    ICM_ERR_PARAM     = -5, // Missing optional context field or invalid argument
+    ICM_ERR_SELFTEST  = -6, // Self-test completed and at least one axis failed
+    ICM_ERR_FIFO_LOST = -7, // A FIFO burst failed, its rows are lost and the FIFO is flushed before the next read
+} icm_status_t;
 
 /***** Defines ICM20602 Registers *****/
 #define ICM_REG_XG_OFFS_TC_H      0x04
@@ -105,7 +114,39 @@ typedef struct {
 #define ICM_GYRO_SENSITIVITY_1000_DPS 328
 #define ICM_GYRO_SENSITIVITY_2000_DPS 164
 
+#ifndef ICM_INT_PIN
 #define ICM_INT_PIN GPIO_NUM_5
+#endif
+
+#define ICM_FIFO_SIZE           1008
+#define ICM_FIFO_ROW_LEN_SINGLE 8
+#define ICM_FIFO_ROW_LEN_BOTH   14
+
+#define ICM_INIT_POLL_US          200
+#define ICM_INIT_RESET_TIMEOUT_US 100000
+
+#define ICM_PLAN_MAX_RATE_ERROR    0.1f // Largest relative deviation of the planned rate from the target
+#define ICM_PLAN_MIN_HEADROOM_ROWS 2    // Rows kept free above the watermark even at low rates
+
+#define ICM_WM_CTRL_HYSTERESIS_ROWS 4
+#define ICM_WM_CTRL_DECAY_SHIFT     4
+
+#define ICM_AUTORANGE_UP_LSB       30000
+#define ICM_AUTORANGE_DOWN_LSB     14000
+#define ICM_AUTORANGE_HOLD_BATCHES 8
+#define ICM_AUTORANGE_MAX_PENDING  4
+
+#define ICM_SELF_TEST_SAMPLES             200
+#define ICM_SELF_TEST_SETTLE_US           20000
+#define ICM_SELF_TEST_POLL_US             20000
+#define ICM_SELF_TEST_MAX_POLLS           50
+#define ICM_SELF_TEST_GYRO_MIN_RATIO      0.5f
+#define ICM_SELF_TEST_ACCEL_MIN_RATIO     0.5f
+#define ICM_SELF_TEST_ACCEL_MAX_RATIO     1.5f
+#define ICM_SELF_TEST_GYRO_MIN_LSB        (60 * 131)
+#define ICM_SELF_TEST_GYRO_MAX_OFFSET_LSB (20 * 131)
+#define ICM_SELF_TEST_ACCEL_MIN_LSB       (225 * 16384 / 1000)
+#define ICM_SELF_TEST_ACCEL_MAX_LSB       (675 * 16384 / 1000)
 
 typedef enum
 {
@@ -149,6 +190,18 @@ typedef enum
     ICM_GYRO_RANGE_2000_DPS = 3,
 } icm_gyro_dps_t;
 
+typedef enum
+{
+    ICM_EXT_SYNC_DISABLED     = 0,
+    ICM_EXT_SYNC_TEMP_OUT_L   = 1,
+    ICM_EXT_SYNC_GYRO_XOUT_L  = 2,
+    ICM_EXT_SYNC_GYRO_YOUT_L  = 3,
+    ICM_EXT_SYNC_GYRO_ZOUT_L  = 4,
+    ICM_EXT_SYNC_ACCEL_XOUT_L = 5,
+    ICM_EXT_SYNC_ACCEL_YOUT_L = 6,
+    ICM_EXT_SYNC_ACCEL_ZOUT_L = 7,
+} icm_ext_sync_t;
+
 typedef union {
     uint8_t user_gyro_config;
     struct {
@@ -352,6 +405,12 @@ typedef struct {
     int8_t temp;
 } icm_data_t;
 
+typedef struct {
+    int16_t accel[3];
+    int16_t temp;
+    int16_t gyro[3];
+} icm_raw_data_t;
+
 typedef struct {
     uint16_t x;
     uint16_t y;
@@ -359,38 +418,220 @@ typedef struct {
 } icm_offset_t;
 
 typedef struct {
+    uint8_t clock_source;
+    uint16_t sample_rate_hz;
+    icm_accel_dlpf_t accel_dlpf;
+    icm_accel_g_range_t accel_g_range;
+    icm_gyro_dlpf_t gyro_dlpf;
+    icm_gyro_dps_t gyro_dps;
+    bool fifo_accel;
+    bool fifo_gyro;
+    uint16_t watermark_rows;
+    bool fifo_int;
+} icm_init_config_t;
+
+typedef struct {
+    uint8_t who_am_i;
+    uint16_t reset_polls;
+    uint32_t startup_us;
+} icm_init_report_t;
+
+typedef struct {
+    icm_gyro_dlpf_t gyro_dlpf;
+    icm_accel_dlpf_t accel_dlpf;
+    uint8_t divider;
+    uint16_t watermark_rows;
+    float effective_rate_hz;
+    uint16_t bandwidth_hz;
+    uint32_t group_delay_us;
+    uint32_t latency_us;
+    float interrupt_rate_hz;
+} icm_rate_plan_t;
+
+typedef struct {
+    uint8_t row_len;
+    uint16_t capacity_rows;
+    uint16_t min_rows;
+    uint16_t max_rows;
+    uint16_t headroom_rows;
+    uint16_t watermark_rows;
+    uint16_t lag_peak_rows;
+    uint32_t odr_hz;
+    uint32_t retunes;
+    uint32_t overflows;
+} icm_wm_ctrl_t;
+
+typedef struct {
+    uint32_t index;
+    icm_accel_g_range_t accel_range;
+    icm_gyro_dps_t gyro_range;
+    bool ambiguous;
+} icm_autorange_switch_t;
+
+typedef struct {
+    bool fifo_accel;
+    bool fifo_gyro;
+    uint8_t row_len;
+    icm_accel_g_range_t accel_range;
+    icm_gyro_dps_t gyro_range;
+    icm_accel_g_range_t decode_accel_range;
+    icm_gyro_dps_t decode_gyro_range;
+    uint8_t accel_quiet_batches;
+    uint8_t gyro_quiet_batches;
+    uint32_t rows_consumed;
+    icm_autorange_switch_t pending[ICM_AUTORANGE_MAX_PENDING];
+    uint8_t pending_head;
+    uint8_t pending_count;
+    uint32_t switches;
+} icm_autorange_t;
+
+typedef struct {
+    icm_data_t data;
+    icm_accel_g_range_t accel_range;
+    icm_gyro_dps_t gyro_range;
+    bool range_changed;
+    bool valid;
+} icm_autorange_sample_t;
+
+typedef struct {
+    bool pass;
+    bool accel_pass[3];
+    bool gyro_pass[3];
+    int32_t accel_response[3];
+    int32_t gyro_response[3];
+    int32_t accel_factory[3];
+    int32_t gyro_factory[3];
+    float accel_deviation[3];
+    float gyro_deviation[3];
+} icm_self_test_t;
+
+#if ICM_CFG_FIXED_POINT
+typedef uint8_t icm_accel_scale_t; // Right shift of raw * 1000, gives milli-g
+typedef uint16_t icm_gyro_scale_t; // LSB per 0.1 dps
+#else
+typedef float icm_accel_scale_t; // milli-g per LSB
+typedef float icm_gyro_scale_t;  // dps per LSB
+#endif
+
+typedef struct {
+#if ICM_CFG_LAYOUT == ICM_CFG_LAYOUT_RUNTIME
     uint8_t fifoRowLen;
-    uint8_t accel_sensitivity;
-    uint16_t gyro_sensitivity;
+#endif
+#if ICM_CFG_HAS_ACCEL
+    icm_accel_scale_t accel_sensitivity;
+#endif
+#if ICM_CFG_HAS_GYRO
+    icm_gyro_scale_t gyro_sensitivity;
+#endif
+#if ICM_CFG_OFFSETS && ICM_CFG_HAS_ACCEL
     icm_offset_t accel_offset;
+#endif
+#if ICM_CFG_OFFSETS && ICM_CFG_HAS_GYRO
     icm_offset_t gyro_offset;
+#endif
+    bool fifo_reset_pending;
+    uint16_t fifo_count;
 } icm_dev_t;
 
-void icmReset(icmdev_ctx_t *ctx);
-void icmSetClock(icmdev_ctx_t *ctx, uint8_t clock_source);
-void icmSetSampleRate(icmdev_ctx_t *ctx, uint16_t sample_ratehz);
-void icmSetSleep(icmdev_ctx_t *ctx, bool enable);
-void icmSetFIFO(icmdev_ctx_t *ctx, bool acc_enable, bool gyro_enable);
-void icmSetFIFOInt(icmdev_ctx_t *ctx, bool enable);
-void icmSetAccelOffsetAxis(icmdev_ctx_t *ctx, uint16_t x_offset, uint16_t y_offset, uint16_t z_offset);
-void icmGetAccelOffsetAxis(icmdev_ctx_t *ctx, icm_offset_t *accel_offset);
-void icmSetAccelAxis(icmdev_ctx_t *ctx, bool enable_x, bool enable_y, bool enable_z);
-void icmSetAccelLPF(icmdev_ctx_t *ctx, icm_accel_dlpf_t accel_dlpf);
-void icmSetAccelGRange(icmdev_ctx_t *ctx, icm_accel_g_range_t accel_g_range);
-void icmSetAccelWoMThresholdAxis(icmdev_ctx_t *ctx, uint8_t x_wom_th, uint8_t y_wom_th, uint8_t z_wom_th);
-void icmSetWaterMarkThreshold(icmdev_ctx_t *ctx, uint16_t watermark_th);
-void icmSetGyroOffsetAxis(icmdev_ctx_t *ctx, uint16_t x_offset, uint16_t y_offset, uint16_t z_offset);
-void icmGetGyroOffsetAxis(icmdev_ctx_t *ctx, icm_offset_t *gyro_offset);
-void icmSetGyroAxis(icmdev_ctx_t *ctx, bool enable_x, bool enable_y, bool enable_z);
-void icmSetGyroLPF(icmdev_ctx_t *ctx, icm_gyro_dlpf_t gyro_dlpf);
-void icmSetGyroDPS(icmdev_ctx_t *ctx, icm_gyro_dps_t gyro_dps);
-void icmGetGyroOffsetAxis(icmdev_ctx_t *ctx, icm_offset_t *gyro_offset);
-void icmGetAccelDataWithTemp(icmdev_ctx_t *ctx, icm_data_t *p_accel);
-void icmGetGyroData(icmdev_ctx_t *ctx, icm_data_t *p_gyro);
-void icmGetAccelGyroData(icmdev_ctx_t *ctx, icm_data_t *p_accel, icm_data_t *p_gyro);
-void icmGetTempData(icmdev_ctx_t *ctx, int16_t *p_TempData);
-void icmGetFifoAccelData(icmdev_ctx_t *ctx);
-void icmGetFifoGyroData(icmdev_ctx_t *ctx);
-void icmGetFifoAccelGyroData(icmdev_ctx_t *ctx);
+typedef struct {
+    /** Component mandatory fields **/
+    icmdev_write_ptr write_reg;
+    icmdev_read_ptr read_reg;
+    /** Customizable optional pointer **/
+    void *handle;
+    /** Component optional fields, used by icmInit **/
+    icmdev_delay_ptr delay_us;
+    icmdev_time_ptr get_time_us;
+    /** Component optional field, called with handle once a transfer failed ICM_CFG_BUS_RETRIES + 1 times **/
+    icmdev_recover_ptr recover;
+    /** Driver state of this device, zero until icmInit **/
+    icm_dev_t state;
+} icmdev_ctx_t;
+
+typedef struct {
+    uint8_t gyro_offset_config[12];
+    uint8_t wom_fifo_en[4];
+    uint8_t int_config[2];
+    uint8_t fifo_wm[2];
+    uint8_t intel_user_power[4];
+    uint8_t i2c_if;
+    uint8_t accel_offset[8];
+    icm_dev_t dev;
+} icm_snapshot_t;
+
+icm_status_t icmReadReg(icmdev_ctx_t *ctx, uint8_t reg, uint8_t *p_buf, uint16_t len);
+icm_status_t icmWriteReg(icmdev_ctx_t *ctx, uint8_t reg, const uint8_t *p_buf, uint16_t len);
+icm_status_t icmReadRegOnce(icmdev_ctx_t *ctx, uint8_t reg, uint8_t *p_buf, uint16_t len);
+icm_status_t icmResetFifo(icmdev_ctx_t *ctx);
+icm_status_t icmReset(icmdev_ctx_t *ctx);
+icm_status_t icmInit(icmdev_ctx_t *ctx, const icm_init_config_t *config, icm_init_report_t *report);
+#if ICM_CFG_SELF_TEST
+icm_status_t icmSelfTest(icmdev_ctx_t *ctx, icm_self_test_t *result);
+#endif
+icm_status_t icmSetClock(icmdev_ctx_t *ctx, uint8_t clock_source);
+icm_status_t icmSetSampleRate(icmdev_ctx_t *ctx, uint16_t sample_ratehz);
+#if ICM_CFG_RATE_PLAN
+bool icmPlanRate(float odr_hz, uint16_t bandwidth_hz, uint32_t latency_budget_us, icm_rate_plan_t *plan);
+icm_status_t icmSetRatePlan(icmdev_ctx_t *ctx, const icm_rate_plan_t *plan);
+#endif
+icm_status_t icmSetSleep(icmdev_ctx_t *ctx, bool enable);
+#if ICM_CFG_SNAPSHOT
+icm_status_t icmSnapshot(icmdev_ctx_t *ctx, icm_snapshot_t *snapshot);
+icm_status_t icmRestore(icmdev_ctx_t *ctx, const icm_snapshot_t *snapshot, bool reset);
+#endif
+icm_status_t icmSetFIFO(icmdev_ctx_t *ctx, bool acc_enable, bool gyro_enable);
+icm_status_t icmSetFIFOInt(icmdev_ctx_t *ctx, bool enable);
+#if ICM_CFG_OFFSETS
+icm_status_t icmSetAccelOffsetAxis(icmdev_ctx_t *ctx, uint16_t x_offset, uint16_t y_offset, uint16_t z_offset);
+icm_status_t icmGetAccelOffsetAxis(icmdev_ctx_t *ctx, icm_offset_t *accel_offset);
+#endif
+icm_status_t icmSetAccelAxis(icmdev_ctx_t *ctx, bool enable_x, bool enable_y, bool enable_z);
+icm_status_t icmSetAccelLPF(icmdev_ctx_t *ctx, icm_accel_dlpf_t accel_dlpf);
+icm_status_t icmSetAccelGRange(icmdev_ctx_t *ctx, icm_accel_g_range_t accel_g_range);
+#if ICM_CFG_WOM
+icm_status_t icmSetAccelWoMThresholdAxis(icmdev_ctx_t *ctx, uint8_t x_wom_th, uint8_t y_wom_th, uint8_t z_wom_th);
+#endif
+icm_status_t icmSetWaterMarkThreshold(icmdev_ctx_t *ctx, uint16_t watermark_th);
+#if ICM_CFG_WM_CTRL
+icm_status_t icmWaterMarkCtrlInit(icmdev_ctx_t *ctx, icm_wm_ctrl_t *ctrl, uint8_t row_len, uint32_t odr_hz,
+                                  uint16_t min_rows, uint16_t max_rows, uint16_t headroom_rows);
+icm_status_t icmWaterMarkCtrlUpdate(icmdev_ctx_t *ctx, icm_wm_ctrl_t *ctrl, uint16_t fill_rows, uint32_t latency_us);
+#endif
+#if ICM_CFG_OFFSETS
+icm_status_t icmSetGyroOffsetAxis(icmdev_ctx_t *ctx, uint16_t x_offset, uint16_t y_offset, uint16_t z_offset);
+icm_status_t icmGetGyroOffsetAxis(icmdev_ctx_t *ctx, icm_offset_t *gyro_offset);
+#endif
+icm_status_t icmSetGyroAxis(icmdev_ctx_t *ctx, bool enable_x, bool enable_y, bool enable_z);
+icm_status_t icmSetGyroLPF(icmdev_ctx_t *ctx, icm_gyro_dlpf_t gyro_dlpf);
+icm_status_t icmSetGyroDPS(icmdev_ctx_t *ctx, icm_gyro_dps_t gyro_dps);
+#if ICM_CFG_AUTORANGE
+icm_status_t icmAutoRangeInit(icmdev_ctx_t *ctx, icm_autorange_t *autorange, bool fifo_accel, bool fifo_gyro,
+                              icm_accel_g_range_t accel_range, icm_gyro_dps_t gyro_range);
+icm_status_t icmAutoRangeDecode(icmdev_ctx_t *ctx, icm_autorange_t *autorange, const uint8_t *p_rows, uint16_t rows,
+                                icm_autorange_sample_t *p_out);
+void icmAutoRangeLost(icm_autorange_t *autorange);
+#endif
+#if ICM_CFG_HAS_ACCEL
+icm_status_t icmGetAccelDataWithTemp(icmdev_ctx_t *ctx, icm_data_t *p_accel);
+#endif
+#if ICM_CFG_HAS_GYRO
+icm_status_t icmGetGyroData(icmdev_ctx_t *ctx, icm_data_t *p_gyro);
+#endif
+#if ICM_CFG_HAS_ACCEL && ICM_CFG_HAS_GYRO
+icm_status_t icmGetAccelGyroData(icmdev_ctx_t *ctx, icm_data_t *p_accel, icm_data_t *p_gyro);
+#endif
+#if ICM_CFG_TEMPERATURE
+icm_status_t icmGetTempData(icmdev_ctx_t *ctx, int16_t *p_TempData);
+#endif
+#if ICM_CFG_FIFO_READERS
+icm_status_t icmGetFifoAccelData(icmdev_ctx_t *ctx);
+icm_status_t icmGetFifoGyroData(icmdev_ctx_t *ctx);
+icm_status_t icmGetFifoAccelGyroData(icmdev_ctx_t *ctx);
+#endif
+icm_status_t icmSetFsync(icmdev_ctx_t *ctx, icm_ext_sync_t ext_sync, bool active_low);
+icm_status_t icmGetFifoCount(icmdev_ctx_t *ctx, uint16_t *p_count);
+icm_status_t icmPopFifo(icmdev_ctx_t *ctx, uint8_t row_len, uint8_t *p_buf, uint16_t rows);
+icm_status_t icmReadFifo(icmdev_ctx_t *ctx, uint8_t row_len, uint8_t *p_buf, uint16_t max_rows, uint16_t *p_rows);
+void icmParseFifoRow(const uint8_t *p_row, bool accel, bool gyro, icm_raw_data_t *p_raw);
 
 #endif /* MAIN_INC_ICM20602_H */
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "icm20602_allan.h"
+
+#include <string.h>
+
+/**
+ * @brief Log-log slope of the Allan deviation between two points.
+ */
+static float icmAllanSlope(const icm_allan_point_t *a, const icm_allan_point_t *b)
+{
+    return logf(b->adev / a->adev) / logf(b->tau_s / a->tau_s);
+}
+
+/**
+ * @brief Segment whose slope is closest to the given one, searched in [first, last).
+ *
+ * @return Index of the left point of the segment, count if no segment is within ICM_ALLAN_SLOPE_TOLERANCE.
+ */
+static uint8_t icmAllanFindSlope(const icm_allan_point_t *p_points, uint8_t first, uint8_t last, uint8_t count,
+                                 float slope)
+{
+    float best_error = ICM_ALLAN_SLOPE_TOLERANCE;
+    uint8_t best     = count;
+    uint8_t i        = 0;
+
+    for (i = first; (i + 1) < last; i++)
+    {
+        float error = fabsf(icmAllanSlope(&p_points[i], &p_points[i + 1]) - slope);
+        if (error < best_error)
+        {
+            best_error = error;
+            best       = i;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Initialize an empty overlapping Allan variance estimator.
+ *
+ * @note Taus are 1, 2, 3, 4, 6, 8, 12 ... samples. Long taus keep only every stride-th phase value, so each tau holds
+ *       at most ICM_ALLAN_RING_LEN + 1 values and the memory stays fixed however long the capture is, while every
+ *       tau is still averaged over at least 2^ICM_ALLAN_OVERLAP_SHIFT overlapping positions per tau.
+ */
+void icmAllanInit(icm_allan_t *allan)
+{
+    uint8_t octave = 0;
+    uint8_t i      = 0;
+
+    memset(allan, 0, sizeof(*allan));
+    for (octave = 0; octave < ICM_ALLAN_OCTAVES; octave++)
+    {
+        uint64_t m      = (uint64_t)1 << octave;
+        uint64_t stride = m >> ICM_ALLAN_OVERLAP_SHIFT;
+
+        stride               = (stride == 0) ? 1 : stride;
+        allan->tau[i].m      = m;
+        allan->tau[i].stride = stride;
+        i++;
+        if (octave > 0)
+        {
+            allan->tau[i].m      = 3 * (m >> 1);
+            allan->tau[i].stride = stride;
+            i++;
+        }
+    }
+    allan->num_taus = i;
+
+    for (i = 0; i < allan->num_taus; i++)
+    {
+        allan->tau[i].lag      = (uint16_t)(allan->tau[i].m / allan->tau[i].stride);
+        allan->tau[i].ring_len = 2 * allan->tau[i].lag + 1;
+        allan->tau[i].fill     = 1;
+        allan->tau[i].head     = 1;
+    }
+}
+
+/**
+ * @brief Feed raw samples of one axis.
+ *
+ * @note The phase is the running sum of the raw counts in 64 bit integers, so second differences are exact however
+ *       long the capture is. Strides are powers of two and sorted, so a sample only touches the taus whose stride
+ *       divides its index.
+ *
+ * @param p_samples First raw sample.
+ * @param count Number of samples.
+ * @param stride Distance between consecutive samples in int16_t, lets one axis be read out of interleaved rows.
+ */
+void icmAllanAdd(icm_allan_t *allan, const int16_t *p_samples, uint32_t count, uint32_t stride)
+{
+    uint32_t n = 0;
+    uint8_t i  = 0;
+
+    for (n = 0; n < count; n++)
+    {
+        allan->phase += p_samples[(size_t)n * stride];
+        allan->samples++;
+
+        for (i = 0; i < allan->num_taus; i++)
+        {
+            icm_allan_tau_t *tau = &allan->tau[i];
+            uint16_t mid         = 0;
+            uint16_t oldest      = 0;
+            int64_t diff         = 0;
+
+            if ((allan->samples & (tau->stride - 1)) != 0)
+            {
+                break;
+            }
+
+            tau->ring[tau->head] = allan->phase;
+            tau->head            = (tau->head + 1 == tau->ring_len) ? 0 : tau->head + 1;
+            if (tau->fill < tau->ring_len)
+            {
+                tau->fill++;
+                if (tau->fill < tau->ring_len)
+                {
+                    continue;
+                }
+            }
+
+            oldest = tau->head;
+            mid    = oldest + tau->lag;
+            mid    = (mid >= tau->ring_len) ? mid - tau->ring_len : mid;
+            diff   = allan->phase - 2 * tau->ring[mid] + tau->ring[oldest];
+            tau->sum += (double)diff * (double)diff;
+            tau->terms++;
+        }
+    }
+}
+
+/**
+ * @brief Allan deviation of every tau with at least ICM_ALLAN_MIN_CLUSTERS independent clusters.
+ *
+ * @param sample_period_s Sample period in seconds.
+ * @param scale Unit per raw count, e.g. 1 / sensitivity.
+ * @param p_points Destination, ICM_ALLAN_TAUS entries @icm_allan_point_t
+ *
+ * @return Number of points written, sorted by tau.
+ */
+uint8_t icmAllanResult(const icm_allan_t *allan, float sample_period_s, float scale, icm_allan_point_t *p_points)
+{
+    uint8_t count = 0;
+    uint8_t i     = 0;
+
+    for (i = 0; i < allan->num_taus; i++)
+    {
+        const icm_allan_tau_t *tau = &allan->tau[i];
+        double m                   = (double)tau->m;
+
+        if ((tau->terms == 0) || (allan->samples < (2 + ICM_ALLAN_MIN_CLUSTERS) * tau->m))
+        {
+            continue;
+        }
+        p_points[count].tau_s = (float)(m * sample_period_s);
+        p_points[count].adev  = (float)(sqrt(tau->sum / (double)tau->terms / (2.0 * m * m)) * scale);
+        p_points[count].terms = tau->terms;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Read the noise coefficients off an Allan deviation curve.
+ *
+ * @note Random walk is the -1/2 slope line evaluated at 1 s, bias instability the minimum of the curve divided by
+ *       ICM_ALLAN_FLICKER_FACTOR, rate random walk the +1/2 slope line evaluated at 3 s. A coefficient is left at 0
+ *       when the curve has no segment close enough to its slope.
+ *
+ * @param p_points Curve from icmAllanResult @icm_allan_point_t
+ * @param noise Destination, in unit * sqrt(s), unit and unit / sqrt(s) @icm_allan_noise_t
+ */
+void icmAllanNoise(const icm_allan_point_t *p_points, uint8_t count, icm_allan_noise_t *noise)
+{
+    uint8_t minimum = 0;
+    uint8_t i       = 0;
+
+    memset(noise, 0, sizeof(*noise));
+    if (count == 0)
+    {
+        return;
+    }
+
+    for (i = 1; i < count; i++)
+    {
+        if (p_points[i].adev < p_points[minimum].adev)
+        {
+            minimum = i;
+        }
+    }
+    noise->bias_instability       = p_points[minimum].adev / ICM_ALLAN_FLICKER_FACTOR;
+    noise->bias_instability_tau_s = p_points[minimum].tau_s;
+
+    i = icmAllanFindSlope(p_points, 0, minimum + 1, count, ICM_ALLAN_RW_SLOPE);
+    if (i < count)
+    {
+        float tau_s              = sqrtf(p_points[i].tau_s * p_points[i + 1].tau_s);
+        float adev               = sqrtf(p_points[i].adev * p_points[i + 1].adev);
+        noise->random_walk       = adev * sqrtf(tau_s);
+        noise->random_walk_tau_s = tau_s;
+    }
+
+    i = icmAllanFindSlope(p_points, minimum, count, count, ICM_ALLAN_RRW_SLOPE);
+    if (i < count)
+    {
+        float tau_s                   = sqrtf(p_points[i].tau_s * p_points[i + 1].tau_s);
+        float adev                    = sqrtf(p_points[i].adev * p_points[i + 1].adev);
+        noise->rate_random_walk       = adev * sqrtf(3.0f / tau_s);
+        noise->rate_random_walk_tau_s = tau_s;
+    }
+}
+
+// EOF
@@ -0,0 +1,70 @@
+#ifndef MAIN_INC_ICM20602_ALLAN_H
+#define MAIN_INC_ICM20602_ALLAN_H
+
+#include "icm20602.h"
+
+// Octaves of averaging time, the longest tau is 2^(ICM_ALLAN_OCTAVES - 1) samples
+#ifndef ICM_ALLAN_OCTAVES
+#define ICM_ALLAN_OCTAVES 32
+#endif
+
+// Overlap resolution, every tau is evaluated at least 2^ICM_ALLAN_OVERLAP_SHIFT times per tau
+#ifndef ICM_ALLAN_OVERLAP_SHIFT
+#define ICM_ALLAN_OVERLAP_SHIFT 6
+#endif
+
+// Taus averaged over fewer independent clusters are too noisy to report
+#ifndef ICM_ALLAN_MIN_CLUSTERS
+#define ICM_ALLAN_MIN_CLUSTERS 9
+#endif
+
+// Two taus per octave: 2^L and 1.5 * 2^L samples
+#define ICM_ALLAN_TAUS      (2 * ICM_ALLAN_OCTAVES - 1)
+#define ICM_ALLAN_RING_LEN  (3 << ICM_ALLAN_OVERLAP_SHIFT)
+#define ICM_ALLAN_RW_SLOPE  -0.5f
+#define ICM_ALLAN_RRW_SLOPE 0.5f
+// Largest deviation of the log-log slope from the ideal one that still identifies a noise term
+#define ICM_ALLAN_SLOPE_TOLERANCE 0.2f
+// Allan deviation floor of flicker noise is sqrt(2 ln 2 / pi) times the bias instability
+#define ICM_ALLAN_FLICKER_FACTOR 0.664f
+
+typedef struct {
+    uint64_t m;
+    uint64_t stride;
+    uint16_t lag;
+    uint16_t ring_len;
+    uint16_t head;
+    uint16_t fill;
+    int64_t ring[ICM_ALLAN_RING_LEN + 1];
+    double sum;
+    uint64_t terms;
+} icm_allan_tau_t;
+
+typedef struct {
+    int64_t phase;
+    uint64_t samples;
+    uint8_t num_taus;
+    icm_allan_tau_t tau[ICM_ALLAN_TAUS];
+} icm_allan_t;
+
+typedef struct {
+    float tau_s;
+    float adev;
+    uint64_t terms;
+} icm_allan_point_t;
+
+typedef struct {
+    float random_walk;
+    float random_walk_tau_s;
+    float bias_instability;
+    float bias_instability_tau_s;
+    float rate_random_walk;
+    float rate_random_walk_tau_s;
+} icm_allan_noise_t;
+
+void icmAllanInit(icm_allan_t *allan);
+void icmAllanAdd(icm_allan_t *allan, const int16_t *p_samples, uint32_t count, uint32_t stride);
+uint8_t icmAllanResult(const icm_allan_t *allan, float sample_period_s, float scale, icm_allan_point_t *p_points);
+void icmAllanNoise(const icm_allan_point_t *p_points, uint8_t count, icm_allan_noise_t *noise);
+
+#endif /* MAIN_INC_ICM20602_ALLAN_H */
@@ -0,0 +1,91 @@
+#ifndef MAIN_INC_ICM20602_CONFIG_H
+#define MAIN_INC_ICM20602_CONFIG_H
+
+/*
+ * Build time feature selection.
+ *
+ * Every option can be set on the compiler command line, or collected in a project header passed as
+ * -DICM_CONFIG_FILE=\"my_icm_config.h\". Subsystems set to 0 are compiled out together with their prototypes,
+ * so a call to a disabled function fails at build time instead of linking dead code.
+ */
+#ifdef ICM_CONFIG_FILE
+#include ICM_CONFIG_FILE
+#endif
+
+/***** Sensor layout *****/
+#define ICM_CFG_LAYOUT_RUNTIME 0 // Sensors and FIFO row length follow the configuration calls
+#define ICM_CFG_LAYOUT_ACCEL   1 // Accelerometer only, 8 byte FIFO rows
+#define ICM_CFG_LAYOUT_GYRO    2 // Gyroscope only, 8 byte FIFO rows
+#define ICM_CFG_LAYOUT_BOTH    3 // Accelerometer and gyroscope, 14 byte FIFO rows
+
+#ifndef ICM_CFG_LAYOUT
+#define ICM_CFG_LAYOUT ICM_CFG_LAYOUT_RUNTIME
+#endif
+
+/***** Conversion path *****/
+// 1: Integer shift and divide, no FPU needed. 0: One float multiply per value, faster on parts with an FPU.
+#ifndef ICM_CFG_FIXED_POINT
+#define ICM_CFG_FIXED_POINT 1
+#endif
+
+/***** Bus *****/
+// Extra attempts per register transfer before the recovery hook runs, bounds the worst case of every call
+#ifndef ICM_CFG_BUS_RETRIES
+#define ICM_CFG_BUS_RETRIES 2
+#endif
+
+// Worst case time from a watermark interrupt to the end of its FIFO drain, icmPlanRate keeps FIFO headroom for it
+#ifndef ICM_CFG_DRAIN_US
+#define ICM_CFG_DRAIN_US 250
+#endif
+
+/***** Subsystems *****/
+#ifndef ICM_CFG_WOM
+#define ICM_CFG_WOM 1
+#endif
+
+#ifndef ICM_CFG_OFFSETS
+#define ICM_CFG_OFFSETS 1
+#endif
+
+// icmGetFifoAccelData, icmGetFifoGyroData and icmGetFifoAccelGyroData
+#ifndef ICM_CFG_FIFO_READERS
+#define ICM_CFG_FIFO_READERS 1
+#endif
+
+#ifndef ICM_CFG_TEMPERATURE
+#define ICM_CFG_TEMPERATURE 1
+#endif
+
+// Also drops the 1008 byte FIFO buffer from RAM
+#ifndef ICM_CFG_SELF_TEST
+#define ICM_CFG_SELF_TEST 1
+#endif
+
+#ifndef ICM_CFG_RATE_PLAN
+#define ICM_CFG_RATE_PLAN 1
+#endif
+
+#ifndef ICM_CFG_WM_CTRL
+#define ICM_CFG_WM_CTRL 1
+#endif
+
+#ifndef ICM_CFG_AUTORANGE
+#define ICM_CFG_AUTORANGE 1
+#endif
+
+#ifndef ICM_CFG_SNAPSHOT
+#define ICM_CFG_SNAPSHOT 1
+#endif
+
+/***** Derived *****/
+#define ICM_CFG_HAS_ACCEL (ICM_CFG_LAYOUT != ICM_CFG_LAYOUT_GYRO)
+#define ICM_CFG_HAS_GYRO  (ICM_CFG_LAYOUT != ICM_CFG_LAYOUT_ACCEL)
+
+#if ICM_CFG_LAYOUT == ICM_CFG_LAYOUT_BOTH
+#define ICM_CFG_FIFO_ROW_LEN ICM_FIFO_ROW_LEN_BOTH
+#elif ICM_CFG_LAYOUT != ICM_CFG_LAYOUT_RUNTIME
+#define ICM_CFG_FIFO_ROW_LEN ICM_FIFO_ROW_LEN_SINGLE
+#endif
+
+#endif /* MAIN_INC_ICM20602_CONFIG_H */
@@ -0,0 +1,285 @@
+#if defined(__linux__) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "icm20602_event.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#define ICM_EVENT_MAX_READY 32
+
+/**
+ * @brief Consume every pending notification on the device fd.
+ *
+ * @return Number of notifications, 0 if nothing was pending, -1 on error.
+ */
+static int icmEventConsume(icm_event_dev_t *dev)
+{
+    int pending = 0;
+
+    for (;;)
+    {
+        struct gpio_v2_line_event event = {0};
+        uint64_t counter                = 0;
+        ssize_t len                     = 0;
+
+        if (dev->fd_kind == ICM_EVENT_FD_EVENTFD)
+        {
+            len = read(dev->fd, &counter, sizeof(counter));
+        }
+        else
+        {
+            len = read(dev->fd, &event, sizeof(event));
+        }
+
+        if ((len > 0) && (dev->fd_kind == ICM_EVENT_FD_EVENTFD))
+        {
+            pending += (int)counter;
+        }
+        else if (len > 0)
+        {
+            pending++;
+        }
+        else if ((len < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        else if ((len < 0) && (errno == EAGAIN))
+        {
+            return pending;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief Initialize an event device, no fd is attached yet.
+ *
+ * @param ctx Device context, must stay valid while the event device is used.
+ * @param row_len FIFO row length in bytes, ICM_FIFO_ROW_LEN_SINGLE or ICM_FIFO_ROW_LEN_BOTH.
+ * @param handler Called with (handler_arg, rows, row count, row length) for every drained burst.
+ * @param handler_arg User pointer passed to the handler.
+ */
+void icmEventInit(icm_event_dev_t *dev, icmdev_ctx_t *ctx, uint8_t row_len, icm_event_handler_ptr handler,
+                  void *handler_arg)
+{
+    memset(dev, 0, sizeof(*dev));
+    dev->ctx         = ctx;
+    dev->fd          = -1;
+    dev->row_len     = row_len;
+    dev->handler     = handler;
+    dev->handler_arg = handler_arg;
+}
+
+/**
+ * @brief Attach a non-blocking eventfd, raised from software with icmEventSignal.
+ *
+ * @note Useful when the interrupt arrives through another path, or to fake interrupts in tests.
+ *
+ * @return The fd, -1 on error.
+ */
+int icmEventOpenEventfd(icm_event_dev_t *dev)
+{
+    dev->fd      = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    dev->fd_kind = (dev->fd >= 0) ? ICM_EVENT_FD_EVENTFD : ICM_EVENT_FD_NONE;
+    return dev->fd;
+}
+
+/**
+ * @brief Attach the INT pin through a GPIO character device line request, uAPI v2.
+ *
+ * @param chip_path GPIO chip, e.g. "/dev/gpiochip0".
+ * @param line Line offset of the INT pin on the chip.
+ * @param active_low 0: Trigger on rising edge, INT pin active high
+ *                   1: Trigger on falling edge, INT pin active low
+ *
+ * @return The fd, -1 on error.
+ */
+int icmEventOpenGpio(icm_event_dev_t *dev, const char *chip_path, uint32_t line, bool active_low)
+{
+    struct gpio_v2_line_request req = {0};
+    int chip_fd                     = open(chip_path, O_RDONLY | O_CLOEXEC);
+    int ret                         = 0;
+
+    if (chip_fd < 0)
+    {
+        return -1;
+    }
+    req.offsets[0]   = line;
+    req.num_lines    = 1;
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+    req.config.flags |= active_low ? GPIO_V2_LINE_FLAG_EDGE_FALLING : GPIO_V2_LINE_FLAG_EDGE_RISING;
+    strncpy(req.consumer, "icm20602", sizeof(req.consumer) - 1);
+    ret = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req);
+    close(chip_fd);
+    if (ret < 0)
+    {
+        return -1;
+    }
+    if (fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK) < 0)
+    {
+        close(req.fd);
+        return -1;
+    }
+    dev->fd      = req.fd;
+    dev->fd_kind = ICM_EVENT_FD_GPIO;
+    return dev->fd;
+}
+
+/**
+ * @brief Raise the eventfd of a device.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int icmEventSignal(icm_event_dev_t *dev)
+{
+    return eventfd_write(dev->fd, 1);
+}
+
+/**
+ * @brief Close the attached fd.
+ */
+void icmEventClose(icm_event_dev_t *dev)
+{
+    if (dev->fd >= 0)
+    {
+        close(dev->fd);
+        dev->fd      = -1;
+        dev->fd_kind = ICM_EVENT_FD_NONE;
+    }
+}
+
+/**
+ * @brief Add the device fd to an epoll set, the device pointer is kept as event data.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int icmEventRegister(int epfd, icm_event_dev_t *dev)
+{
+    struct epoll_event ev = {0};
+    ev.events             = EPOLLIN;
+    ev.data.ptr           = dev;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, dev->fd, &ev);
+}
+
+/**
+ * @brief Non-blocking service of one device.
+ *
+ * @note Returns immediately without bus traffic when no interrupt is pending and the previous call succeeded.
+ *       Otherwise FIFO_WM_INT_STATUS and INT_STATUS are read in one burst to release a latched watermark or data
+ *       interrupt and the FIFO is drained in whole-row bursts until it is empty, at most ICM_EVENT_MAX_PASSES
+ *       bursts per call. A bus error stops the drain, counts in dev->errors and sets errno to EIO. The status
+ *       registers and FIFO_R_W change on read and are never retried, a failed read of either flushes the FIFO and
+ *       counts in dev->losses. The interrupt may then still be latched and no new edge arrives, so
+ *       dev->needs_service is set and the next call retries without a pending notification. The same holds when
+ *       the FIFO refills faster than the pass limit drains it. Call icmService on such devices when
+ *       icmEventDispatch times out.
+ *
+ * @return Number of rows delivered to the handler, -1 on error.
+ */
+int icmService(icm_event_dev_t *dev)
+{
+    icm_int_status_t int_status = {0};
+    uint8_t status[2]           = {0};
+    icm_status_t ret            = ICM_OK;
+    uint16_t rows               = 0;
+    uint16_t pass               = 0;
+    int delivered               = 0;
+    int pending                 = icmEventConsume(dev);
+
+    if ((pending < 0) || ((pending == 0) && !dev->needs_service))
+    {
+        return pending;
+    }
+    dev->events += pending;
+
+    dev->needs_service = true;
+    if (icmReadRegOnce(dev->ctx, ICM_REG_FIFO_WM_INT_STATUS, status, 2) != ICM_OK)
+    {
+        icmResetFifo(dev->ctx);
+        dev->losses++;
+        dev->errors++;
+        errno = EIO;
+        return -1;
+    }
+    int_status.user_int_status = status[1];
+    if (int_status.bits.fifo_oflow_int)
+    {
+        dev->overflows++;
+    }
+
+    for (pass = 0; pass < ICM_EVENT_MAX_PASSES; pass++)
+    {
+        ret = icmReadFifo(dev->ctx, dev->row_len, dev->buf, ICM_FIFO_SIZE / dev->row_len, &rows);
+        if (ret != ICM_OK)
+        {
+            if (ret == ICM_ERR_FIFO_LOST)
+            {
+                dev->losses++;
+            }
+            dev->errors++;
+            errno = EIO;
+            return -1;
+        }
+        if (rows == 0)
+        {
+            dev->needs_service = false;
+            break;
+        }
+        dev->handler(dev->handler_arg, dev->buf, rows, dev->row_len);
+        delivered += rows;
+    }
+    return delivered;
+}
+
+/**
+ * @brief Wait on an epoll set of registered devices and service the ready ones.
+ *
+ * @note A device that fails does not stop the others, every ready device is serviced and the failure is reported
+ *       once the batch is done. The failed devices are found by their errors count and needs_service flag.
+ *
+ * @param timeout_ms epoll_wait timeout, -1 blocks until a device is ready.
+ *
+ * @return Number of devices serviced, -1 on error with errno EIO if any device failed.
+ */
+int icmEventDispatch(int epfd, int timeout_ms)
+{
+    struct epoll_event ready[ICM_EVENT_MAX_READY];
+    int n      = epoll_wait(epfd, ready, ICM_EVENT_MAX_READY, timeout_ms);
+    int failed = 0;
+    int i      = 0;
+
+    if (n < 0)
+    {
+        return (errno == EINTR) ? 0 : -1;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (icmService((icm_event_dev_t *)ready[i].data.ptr) < 0)
+        {
+            failed++;
+        }
+    }
+    if (failed > 0)
+    {
+        errno = EIO;
+        return -1;
+    }
+    return n;
+}
+
+#endif /* __linux__ */
+
+// EOF
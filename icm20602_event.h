@@ -0,0 +1,44 @@
+#ifndef MAIN_INC_ICM20602_EVENT_H
+#define MAIN_INC_ICM20602_EVENT_H
+
+#include "icm20602.h"
+
+#ifndef ICM_EVENT_MAX_PASSES
+#define ICM_EVENT_MAX_PASSES 4 // FIFO bursts per icmService call
+#endif
+
+typedef void (*icm_event_handler_ptr)(void *, const uint8_t *, uint16_t, uint8_t);
+
+typedef enum
+{
+    ICM_EVENT_FD_NONE    = 0,
+    ICM_EVENT_FD_EVENTFD = 1, // Reads return the accumulated 64 bit counter
+    ICM_EVENT_FD_GPIO    = 2, // Reads return one gpio_v2_line_event per edge
+} icm_event_fd_t;
+
+typedef struct {
+    icmdev_ctx_t *ctx;
+    int fd;
+    icm_event_fd_t fd_kind;
+    uint8_t row_len;
+    icm_event_handler_ptr handler;
+    void *handler_arg;
+    bool needs_service;
+    uint32_t events;
+    uint32_t overflows;
+    uint32_t losses;
+    uint32_t errors;
+    uint8_t buf[ICM_FIFO_SIZE];
+} icm_event_dev_t;
+
+void icmEventInit(icm_event_dev_t *dev, icmdev_ctx_t *ctx, uint8_t row_len, icm_event_handler_ptr handler,
+                  void *handler_arg);
+int icmEventOpenEventfd(icm_event_dev_t *dev);
+int icmEventOpenGpio(icm_event_dev_t *dev, const char *chip_path, uint32_t line, bool active_low);
+int icmEventSignal(icm_event_dev_t *dev);
+void icmEventClose(icm_event_dev_t *dev);
+int icmEventRegister(int epfd, icm_event_dev_t *dev);
+int icmService(icm_event_dev_t *dev);
+int icmEventDispatch(int epfd, int timeout_ms);
+
+#endif /* MAIN_INC_ICM20602_EVENT_H */
@@ -0,0 +1,280 @@
+#include "icm20602_features.h"
+
+#include <string.h>
+
+#define ICM_FEATURE_PI 3.14159265358979f
+
+/**
+ * @brief Update running mean and central moments up to the fourth with one sample.
+ */
+static void icmFeatureMomentsAdd(icm_feature_moments_t *m, float x)
+{
+    float n1      = (float)m->n;
+    float n       = n1 + 1.0f;
+    float delta   = x - m->mean;
+    float delta_n = delta / n;
+    float dn2     = delta_n * delta_n;
+    float term1   = delta * delta_n * n1;
+
+    m->mean += delta_n;
+    m->m4 += term1 * dn2 * (n * n - 3.0f * n + 3.0f) + 6.0f * dn2 * m->m2 - 4.0f * delta_n * m->m3;
+    m->m3 += term1 * delta_n * (n - 2.0f) - 3.0f * delta_n * m->m2;
+    m->m2 += term1;
+    m->n++;
+}
+
+/**
+ * @brief In-place radix-2 complex FFT of ICM_FEATURE_FFT_HALF points, input already in bit reversed order.
+ *
+ * @note Real and imaginary parts are kept in separate arrays and every stage has its own contiguous twiddle run,
+ *       so the butterfly loop is unit stride and the compiler can vectorize it.
+ */
+static void icmFeatureFft(icm_feature_t *feature)
+{
+    float *re     = feature->re;
+    float *im     = feature->im;
+    uint16_t half = 0;
+    uint16_t base = 0;
+    uint16_t j    = 0;
+
+    for (half = 1; half < ICM_FEATURE_FFT_HALF; half <<= 1)
+    {
+        const float *restrict wr = &feature->tw_re[half - 1];
+        const float *restrict wi = &feature->tw_im[half - 1];
+
+        for (base = 0; base < ICM_FEATURE_FFT_HALF; base += 2 * half)
+        {
+            float *restrict ar = &re[base];
+            float *restrict ai = &im[base];
+            float *restrict br = &re[base + half];
+            float *restrict bi = &im[base + half];
+
+            for (j = 0; j < half; j++)
+            {
+                float tr = br[j] * wr[j] - bi[j] * wi[j];
+                float ti = br[j] * wi[j] + bi[j] * wr[j];
+                br[j]    = ar[j] - tr;
+                bi[j]    = ai[j] - ti;
+                ar[j]    = ar[j] + tr;
+                ai[j]    = ai[j] + ti;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Window one axis, run the real FFT and add the band powers of this window.
+ *
+ * @note The real sequence is packed as N/2 complex points and unpacked with the split twiddles afterwards.
+ *       Band power is the one-sided periodogram normalized by the window power, i.e. the mean square of the
+ *       signal inside the band, in the squared unit of the input.
+ */
+static void icmFeatureWindow(icm_feature_t *feature, uint8_t axis)
+{
+    const float *x = feature->samples[axis];
+    float power[ICM_FEATURE_FFT_HALF + 1];
+    float mean     = 0;
+    float peak     = 0;
+    float scale    = 1.0f / (ICM_FEATURE_FFT_LEN * feature->window_power);
+    uint16_t k     = 0;
+    uint8_t band   = 0;
+
+    for (k = 0; k < ICM_FEATURE_FFT_LEN; k++)
+    {
+        mean += x[k];
+    }
+    mean /= ICM_FEATURE_FFT_LEN;
+    for (k = 0; k < ICM_FEATURE_FFT_HALF; k++)
+    {
+        uint16_t r     = feature->bitrev[k];
+        float even     = x[2 * k] - mean;
+        float odd      = x[2 * k + 1] - mean;
+        float a_even   = fabsf(even);
+        float a_odd    = fabsf(odd);
+        peak           = (a_even > peak) ? a_even : peak;
+        peak           = (a_odd > peak) ? a_odd : peak;
+        feature->re[r] = even * feature->window[2 * k];
+        feature->im[r] = odd * feature->window[2 * k + 1];
+    }
+    if (peak > feature->moments[axis].peak)
+    {
+        feature->moments[axis].peak = peak;
+    }
+
+    icmFeatureFft(feature);
+
+    power[0]                    = (feature->re[0] + feature->im[0]) * (feature->re[0] + feature->im[0]);
+    power[ICM_FEATURE_FFT_HALF] = (feature->re[0] - feature->im[0]) * (feature->re[0] - feature->im[0]);
+    for (k = 1; k < ICM_FEATURE_FFT_HALF; k++)
+    {
+        uint16_t c = ICM_FEATURE_FFT_HALF - k;
+        float e_re = 0.5f * (feature->re[k] + feature->re[c]);
+        float e_im = 0.5f * (feature->im[k] - feature->im[c]);
+        float o_re = 0.5f * (feature->im[k] + feature->im[c]);
+        float o_im = -0.5f * (feature->re[k] - feature->re[c]);
+        float x_re = e_re + feature->split_re[k] * o_re - feature->split_im[k] * o_im;
+        float x_im = e_im + feature->split_re[k] * o_im + feature->split_im[k] * o_re;
+        power[k]   = 2.0f * (x_re * x_re + x_im * x_im);
+    }
+
+    for (band = 0; band < ICM_FEATURE_BANDS; band++)
+    {
+        float sum = 0;
+        for (k = feature->band_bin[band]; k < feature->band_bin[band + 1]; k++)
+        {
+            sum += power[k];
+        }
+        feature->band_acc[axis][band] += sum * scale;
+    }
+}
+
+/**
+ * @brief Initialize the feature extractor.
+ *
+ * @note The samples are taken as raw LSB and scaled in float, the integer milli-g and dps of icm_data_t would round
+ *       gyroscope noise and small vibrations away.
+ *
+ * @param source Which sensor of the raw samples to analyse @icm_feature_source_t
+ * @param scale Output unit per LSB, e.g. 1000.0f / 16384 for milli-g at 2 g or 1.0f / 131 for dps at 250 dps.
+ * @param sample_rate_hz Output data rate of the samples.
+ * @param band_edges_hz ICM_FEATURE_BANDS + 1 ascending band edges, band i covers [edge i, edge i+1).
+ * @param windows_per_vector FFT windows of ICM_FEATURE_FFT_LEN samples averaged into one feature vector.
+ */
+void icmFeatureInit(icm_feature_t *feature, icm_feature_source_t source, float scale, float sample_rate_hz,
+                    const float *band_edges_hz, uint8_t windows_per_vector)
+{
+    uint16_t k    = 0;
+    uint16_t half = 0;
+    uint16_t bits = 0;
+
+    memset(feature, 0, sizeof(*feature));
+    feature->source             = source;
+    feature->scale              = scale;
+    feature->windows_per_vector = (windows_per_vector == 0) ? 1 : windows_per_vector;
+
+    for (k = 0; k < ICM_FEATURE_FFT_LEN; k++)
+    {
+        feature->window[k] = 0.5f - 0.5f * cosf(2.0f * ICM_FEATURE_PI * k / ICM_FEATURE_FFT_LEN);
+        feature->window_power += feature->window[k] * feature->window[k];
+    }
+
+    for (half = 1; half < ICM_FEATURE_FFT_HALF; half <<= 1)
+    {
+        for (k = 0; k < half; k++)
+        {
+            feature->tw_re[half - 1 + k] = cosf(-ICM_FEATURE_PI * k / half);
+            feature->tw_im[half - 1 + k] = sinf(-ICM_FEATURE_PI * k / half);
+        }
+    }
+    for (k = 0; k < ICM_FEATURE_FFT_HALF; k++)
+    {
+        feature->split_re[k] = cosf(-2.0f * ICM_FEATURE_PI * k / ICM_FEATURE_FFT_LEN);
+        feature->split_im[k] = sinf(-2.0f * ICM_FEATURE_PI * k / ICM_FEATURE_FFT_LEN);
+    }
+
+    for (half = ICM_FEATURE_FFT_HALF; half > 1; half >>= 1)
+    {
+        bits++;
+    }
+    for (k = 0; k < ICM_FEATURE_FFT_HALF; k++)
+    {
+        uint16_t r = 0;
+        uint16_t b = 0;
+        for (b = 0; b < bits; b++)
+        {
+            r |= ((k >> b) & 1) << (bits - 1 - b);
+        }
+        feature->bitrev[k] = r;
+    }
+
+    for (k = 0; k <= ICM_FEATURE_BANDS; k++)
+    {
+        float bin = band_edges_hz[k] * ICM_FEATURE_FFT_LEN / sample_rate_hz + 0.5f;
+        if (bin < 0)
+        {
+            bin = 0;
+        }
+        if (bin > ICM_FEATURE_FFT_HALF + 1)
+        {
+            bin = ICM_FEATURE_FFT_HALF + 1;
+        }
+        feature->band_bin[k] = (uint16_t)bin;
+    }
+}
+
+/**
+ * @brief Feed raw samples and collect finished feature vectors.
+ *
+ * @note RMS, crest factor and kurtosis are computed about the running mean over all samples of a vector, peak is
+ *       taken about each window mean. Band powers are averaged over the windows of a vector.
+ *
+ * @param p_data Raw samples, e.g. from icmParseFifoRow, features are in the unit of the scale @icm_raw_data_t
+ * @param count Number of samples.
+ * @param p_out Destination for finished vectors.
+ * @param max_out Capacity of p_out, vectors beyond it are dropped.
+ *
+ * @return Number of vectors written to p_out.
+ */
+uint16_t icmFeatureProcess(icm_feature_t *feature, const icm_raw_data_t *p_data, uint16_t count,
+                           icm_feature_vector_t *p_out, uint16_t max_out)
+{
+    uint16_t emitted = 0;
+    uint16_t i       = 0;
+    uint8_t axis     = 0;
+    uint8_t band     = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        const int16_t *p_raw = (feature->source == ICM_FEATURE_ACCEL) ? p_data[i].accel : p_data[i].gyro;
+
+        for (axis = 0; axis < 3; axis++)
+        {
+            float value = p_raw[axis] * feature->scale;
+
+            feature->samples[axis][feature->fill] = value;
+            icmFeatureMomentsAdd(&feature->moments[axis], value);
+        }
+        if (++feature->fill < ICM_FEATURE_FFT_LEN)
+        {
+            continue;
+        }
+
+        feature->fill = 0;
+        for (axis = 0; axis < 3; axis++)
+        {
+            icmFeatureWindow(feature, axis);
+        }
+        if (++feature->windows < feature->windows_per_vector)
+        {
+            continue;
+        }
+
+        if (emitted < max_out)
+        {
+            icm_feature_vector_t *out = &p_out[emitted++];
+            out->sequence             = feature->sequence;
+            out->samples              = feature->moments[0].n;
+            for (axis = 0; axis < 3; axis++)
+            {
+                icm_feature_moments_t *m = &feature->moments[axis];
+                icm_feature_axis_t *a    = &out->axis[axis];
+
+                a->rms      = sqrtf(m->m2 / m->n);
+                a->peak     = m->peak;
+                a->crest    = (a->rms > 0) ? a->peak / a->rms : 0;
+                a->kurtosis = (m->m2 > 0) ? (m->n * m->m4) / (m->m2 * m->m2) : 0;
+                for (band = 0; band < ICM_FEATURE_BANDS; band++)
+                {
+                    a->band_power[band] = feature->band_acc[axis][band] / feature->windows;
+                }
+            }
+        }
+        feature->sequence++;
+        feature->windows = 0;
+        memset(feature->band_acc, 0, sizeof(feature->band_acc));
+        memset(feature->moments, 0, sizeof(feature->moments));
+    }
+    return emitted;
+}
+
+// EOF
@@ -0,0 +1,72 @@
+#ifndef MAIN_INC_ICM20602_FEATURES_H
+#define MAIN_INC_ICM20602_FEATURES_H
+
+#include "icm20602.h"
+
+#ifndef ICM_FEATURE_FFT_LEN
+#define ICM_FEATURE_FFT_LEN 256
+#endif
+
+#ifndef ICM_FEATURE_BANDS
+#define ICM_FEATURE_BANDS 8
+#endif
+
+#define ICM_FEATURE_FFT_HALF (ICM_FEATURE_FFT_LEN / 2)
+
+typedef enum
+{
+    ICM_FEATURE_ACCEL = 0,
+    ICM_FEATURE_GYRO  = 1,
+} icm_feature_source_t;
+
+typedef struct {
+    float rms;
+    float peak;
+    float crest;
+    float kurtosis;
+    float band_power[ICM_FEATURE_BANDS];
+} icm_feature_axis_t;
+
+typedef struct {
+    uint32_t sequence;
+    uint32_t samples;
+    icm_feature_axis_t axis[3];
+} icm_feature_vector_t;
+
+typedef struct {
+    uint32_t n;
+    float mean;
+    float m2;
+    float m3;
+    float m4;
+    float peak;
+} icm_feature_moments_t;
+
+typedef struct {
+    icm_feature_source_t source;
+    float scale;
+    uint8_t windows_per_vector;
+    uint8_t windows;
+    uint16_t fill;
+    uint32_t sequence;
+    uint16_t band_bin[ICM_FEATURE_BANDS + 1];
+    float window_power;
+    float window[ICM_FEATURE_FFT_LEN];
+    float tw_re[ICM_FEATURE_FFT_HALF];
+    float tw_im[ICM_FEATURE_FFT_HALF];
+    float split_re[ICM_FEATURE_FFT_HALF];
+    float split_im[ICM_FEATURE_FFT_HALF];
+    uint16_t bitrev[ICM_FEATURE_FFT_HALF];
+    float samples[3][ICM_FEATURE_FFT_LEN];
+    float re[ICM_FEATURE_FFT_HALF];
+    float im[ICM_FEATURE_FFT_HALF];
+    float band_acc[3][ICM_FEATURE_BANDS];
+    icm_feature_moments_t moments[3];
+} icm_feature_t;
+
+void icmFeatureInit(icm_feature_t *feature, icm_feature_source_t source, float scale, float sample_rate_hz,
+                    const float *band_edges_hz, uint8_t windows_per_vector);
+uint16_t icmFeatureProcess(icm_feature_t *feature, const icm_raw_data_t *p_data, uint16_t count,
+                           icm_feature_vector_t *p_out, uint16_t max_out);
+
+#endif /* MAIN_INC_ICM20602_FEATURES_H */
@@ -0,0 +1,239 @@
+#include "icm20602_sched.h"
+
+#include <string.h>
+
+/**
+ * @brief Time at which a device FIFO reaches the given number of rows.
+ */
+static uint32_t icmSchedRowsTime(const icm_sched_dev_t *dev, uint16_t rows)
+{
+    if (rows <= dev->rows_left)
+    {
+        return dev->last_us;
+    }
+    return dev->last_us + (uint32_t)(((uint64_t)(rows - dev->rows_left) * 1000000) / dev->odr_hz);
+}
+
+/**
+ * @brief Read the FIFO count of one device and restart its fill prediction from it.
+ *
+ * @note A failed count read or an impossible count keeps the previous prediction, so the device stays due.
+ */
+static icm_status_t icmSchedCount(icm_sched_t *sched, uint8_t device, uint32_t now_us)
+{
+    icm_sched_dev_t *dev = &sched->dev[device];
+    uint16_t count       = 0;
+    icm_status_t ret     = icmGetFifoCount(dev->ctx, &count);
+
+    if (ret != ICM_OK)
+    {
+        dev->errors++;
+        return ret;
+    }
+    dev->rows_left = count / dev->row_len;
+    if (dev->rows_left > dev->capacity_rows)
+    {
+        dev->rows_left = dev->capacity_rows;
+    }
+    dev->last_us = now_us;
+    return ICM_OK;
+}
+
+/**
+ * @brief Drain exactly the rows of one device that icmSchedCount confirmed into the sink.
+ *
+ * @note Only counted rows are popped, a burst sized from the prediction could run past the rows latched in the
+ *       FIFO. Rows that arrived after the count stay in the FIFO and are predicted from the count time on. Lost
+ *       rows are counted as errors and the prediction restarts from the flushed FIFO.
+ */
+static icm_status_t icmSchedDrain(icm_sched_t *sched, uint8_t device, uint32_t now_us)
+{
+    icm_sched_dev_t *dev = &sched->dev[device];
+    uint16_t rows        = dev->rows_left;
+    icm_status_t ret     = ICM_OK;
+
+    dev->slack_us = (int32_t)(icmSchedRowsTime(dev, dev->capacity_rows) - now_us);
+    if (dev->slack_us < dev->min_slack_us)
+    {
+        dev->min_slack_us = dev->slack_us;
+    }
+
+    ret            = icmPopFifo(dev->ctx, dev->row_len, sched->buf, rows);
+    dev->rows_left = 0;
+    if (ret != ICM_OK)
+    {
+        dev->last_us = now_us;
+        dev->errors++;
+        return ret;
+    }
+
+    if (rows >= dev->capacity_rows)
+    {
+        dev->overflows++;
+    }
+    if (rows > 0)
+    {
+        sched->sink(sched->sink_arg, device, sched->buf, rows, dev->row_len);
+    }
+    dev->drained_rows += rows;
+    return ICM_OK;
+}
+
+/**
+ * @brief Initialize an empty bus scheduler.
+ *
+ * @param get_time_us Monotonic microsecond clock, wrapping at 32 bit.
+ * @param sink Called with (sink_arg, device, rows, row count, row length) for every drained burst.
+ * @param sink_arg User pointer passed to the sink.
+ */
+void icmSchedInit(icm_sched_t *sched, icm_sched_time_ptr get_time_us, icm_sched_sink_ptr sink, void *sink_arg)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->get_time_us = get_time_us;
+    sched->sink        = sink;
+    sched->sink_arg    = sink_arg;
+}
+
+/**
+ * @brief Add a device which shares the bus with the others.
+ *
+ * @param ctx Device context, must stay valid while the scheduler is used.
+ * @param row_len FIFO row length in bytes, ICM_FIFO_ROW_LEN_SINGLE or ICM_FIFO_ROW_LEN_BOTH.
+ * @param odr_hz Output data rate written to the FIFO.
+ * @param watermark_rows Rows to collect before the device becomes due, trades bus overhead against slack.
+ * @param p_device Index of the device inside the scheduler.
+ *
+ * @return ICM_ERR_PARAM if the scheduler is full or the configuration is invalid, the device is not added then
+ *         @icm_status_t
+ */
+icm_status_t icmSchedAddDevice(icm_sched_t *sched, icmdev_ctx_t *ctx, uint8_t row_len, uint32_t odr_hz,
+                               uint16_t watermark_rows, uint8_t *p_device)
+{
+    icm_sched_dev_t *dev = NULL;
+
+    if ((sched->num_devices >= ICM_SCHED_MAX_DEVICES) || (row_len == 0) || (odr_hz == 0))
+    {
+        return ICM_ERR_PARAM;
+    }
+
+    dev = &sched->dev[sched->num_devices];
+    memset(dev, 0, sizeof(*dev));
+    dev->ctx            = ctx;
+    dev->row_len        = row_len;
+    dev->capacity_rows  = ICM_FIFO_SIZE / row_len;
+    dev->watermark_rows = (watermark_rows == 0) ? 1 : watermark_rows;
+    if (dev->watermark_rows > dev->capacity_rows)
+    {
+        dev->watermark_rows = dev->capacity_rows;
+    }
+    dev->odr_hz       = odr_hz;
+    dev->min_slack_us = INT32_MAX;
+
+    *p_device = sched->num_devices++;
+    return ICM_OK;
+}
+
+/**
+ * @brief Read the FIFO count of every device back to back and restart the fill prediction from it.
+ *
+ * @note Call once after the FIFOs are enabled, and whenever a device was serviced outside the scheduler.
+ *       A device whose count cannot be read keeps its previous prediction.
+ *
+ * @return First error of any device, ICM_OK if all were anchored @icm_status_t
+ */
+icm_status_t icmSchedAnchor(icm_sched_t *sched)
+{
+    icm_status_t first = ICM_OK;
+    icm_status_t ret   = ICM_OK;
+    uint8_t i          = 0;
+
+    for (i = 0; i < sched->num_devices; i++)
+    {
+        ret   = icmSchedCount(sched, i, sched->get_time_us());
+        first = (first == ICM_OK) ? ret : first;
+    }
+    return first;
+}
+
+/**
+ * @brief Drain every device that is due, earliest overflow deadline first.
+ *
+ * @note A device is due once its predicted fill reaches the watermark. The FIFO counts of all due devices are read
+ *       back to back, then the devices are drained in order of the deadline at which their counted fill would
+ *       overflow, and the round repeats with a fresh clock reading while devices are due. A device whose count or
+ *       drain failed is counted in its errors and skipped for the rest of the call, so a stuck bus costs one
+ *       bounded transfer per device. A call drains at most ICM_SCHED_MAX_PASSES times per device, so a clock that
+ *       is too fast or a device that refills faster than the bus drains it cannot keep the caller in here.
+ *
+ * @return Microseconds until the next device becomes due, the caller may sleep that long. 0 if devices are still
+ *         due after the pass limit.
+ */
+uint32_t icmSchedService(icm_sched_t *sched)
+{
+    bool failed[ICM_SCHED_MAX_DEVICES] = {0};
+    uint16_t max_passes                = (uint16_t)ICM_SCHED_MAX_PASSES * sched->num_devices;
+    uint16_t passes                    = 0;
+
+    while (passes < max_passes)
+    {
+        uint8_t due_devices[ICM_SCHED_MAX_DEVICES] = {0};
+        uint8_t num_due                            = 0;
+        uint32_t now_us                            = sched->get_time_us();
+        int32_t next_wait                          = INT32_MAX;
+        uint8_t i                                  = 0;
+
+        for (i = 0; i < sched->num_devices; i++)
+        {
+            icm_sched_dev_t *dev = &sched->dev[i];
+            int32_t due          = (int32_t)(icmSchedRowsTime(dev, dev->watermark_rows) - now_us);
+
+            if (failed[i])
+            {
+                continue;
+            }
+            if (due > 0)
+            {
+                next_wait = (due < next_wait) ? due : next_wait;
+            }
+            else if (icmSchedCount(sched, i, now_us) == ICM_OK)
+            {
+                due_devices[num_due++] = i;
+            }
+            else
+            {
+                failed[i] = true;
+            }
+        }
+        if (num_due == 0)
+        {
+            return (next_wait == INT32_MAX) ? 0 : (uint32_t)next_wait;
+        }
+
+        while ((num_due > 0) && (passes < max_passes))
+        {
+            int32_t best_dl = INT32_MAX;
+            uint8_t best    = 0;
+
+            for (i = 0; i < num_due; i++)
+            {
+                icm_sched_dev_t *dev = &sched->dev[due_devices[i]];
+                int32_t deadline     = (int32_t)(icmSchedRowsTime(dev, dev->capacity_rows) - now_us);
+
+                if (deadline < best_dl)
+                {
+                    best_dl = deadline;
+                    best    = i;
+                }
+            }
+            if (icmSchedDrain(sched, due_devices[best], sched->get_time_us()) != ICM_OK)
+            {
+                failed[due_devices[best]] = true;
+            }
+            due_devices[best] = due_devices[--num_due];
+            passes++;
+        }
+    }
+    return 0;
+}
+
+// EOF
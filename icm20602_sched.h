@@ -0,0 +1,47 @@
+#ifndef MAIN_INC_ICM20602_SCHED_H
+#define MAIN_INC_ICM20602_SCHED_H
+
+#include "icm20602.h"
+
+#ifndef ICM_SCHED_MAX_DEVICES
+#define ICM_SCHED_MAX_DEVICES 8
+#endif
+
+#ifndef ICM_SCHED_MAX_PASSES
+#define ICM_SCHED_MAX_PASSES 4 // Drains per device and icmSchedService call
+#endif
+
+typedef uint32_t (*icm_sched_time_ptr)(void);
+typedef void (*icm_sched_sink_ptr)(void *, uint8_t, const uint8_t *, uint16_t, uint8_t);
+
+typedef struct {
+    icmdev_ctx_t *ctx;
+    uint8_t row_len;
+    uint16_t capacity_rows;
+    uint16_t watermark_rows;
+    uint32_t odr_hz;
+    uint32_t last_us;
+    uint16_t rows_left;
+    int32_t slack_us;
+    int32_t min_slack_us;
+    uint32_t drained_rows;
+    uint32_t overflows;
+    uint32_t errors;
+} icm_sched_dev_t;
+
+typedef struct {
+    icm_sched_dev_t dev[ICM_SCHED_MAX_DEVICES];
+    uint8_t num_devices;
+    icm_sched_time_ptr get_time_us;
+    icm_sched_sink_ptr sink;
+    void *sink_arg;
+    uint8_t buf[ICM_FIFO_SIZE];
+} icm_sched_t;
+
+void icmSchedInit(icm_sched_t *sched, icm_sched_time_ptr get_time_us, icm_sched_sink_ptr sink, void *sink_arg);
+icm_status_t icmSchedAddDevice(icm_sched_t *sched, icmdev_ctx_t *ctx, uint8_t row_len, uint32_t odr_hz,
+                               uint16_t watermark_rows, uint8_t *p_device);
+icm_status_t icmSchedAnchor(icm_sched_t *sched);
+uint32_t icmSchedService(icm_sched_t *sched);
+
+#endif /* MAIN_INC_ICM20602_SCHED_H */
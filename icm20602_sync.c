@@ -0,0 +1,414 @@
+#include "icm20602_sync.h"
+
+#include <string.h>
+
+/**
+ * @brief Get the FSYNC tag bit of a sample.
+ */
+static bool icmSyncTagBit(const icm_sync_dev_t *dev, const icm_raw_data_t *p_raw)
+{
+    switch (dev->ext_sync)
+    {
+    case (ICM_EXT_SYNC_TEMP_OUT_L):
+        return p_raw->temp & 1;
+    case (ICM_EXT_SYNC_GYRO_XOUT_L):
+        return p_raw->gyro[0] & 1;
+    case (ICM_EXT_SYNC_GYRO_YOUT_L):
+        return p_raw->gyro[1] & 1;
+    case (ICM_EXT_SYNC_GYRO_ZOUT_L):
+        return p_raw->gyro[2] & 1;
+    case (ICM_EXT_SYNC_ACCEL_XOUT_L):
+        return p_raw->accel[0] & 1;
+    case (ICM_EXT_SYNC_ACCEL_YOUT_L):
+        return p_raw->accel[1] & 1;
+    case (ICM_EXT_SYNC_ACCEL_ZOUT_L):
+        return p_raw->accel[2] & 1;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Record an FSYNC tag and refit sample index against FSYNC pulse number.
+ *
+ * @note The tag is latched into the first sample after the edge, so the edge sits half a sample earlier on average.
+ *       A least squares fit with exponential forgetting follows slow oscillator drift. It only averages the latch
+ *       quantization down to a fraction of a sample period when the FSYNC phase sweeps across the samples, see
+ *       icmSyncInit. The first tag after a resync restarts the fit,
+ *       its pulse number is bridged over the gap with the host time between the two tags.
+ *
+ * @param tag_us Host time of the tagged sample, only used with ctx->get_time_us.
+ */
+static void icmSyncTag(icm_sync_t *sync, icm_sync_dev_t *dev, uint64_t index, uint32_t tag_us)
+{
+    uint32_t pulse = 0;
+    double x       = 0;
+    double y       = 0;
+    double det     = 0;
+    double slope   = 0;
+
+    if (dev->resync && (dev->ctx->get_time_us == NULL))
+    {
+        return;
+    }
+    if (dev->resync)
+    {
+        double elapsed = (double)(tag_us - dev->last_tag_us) * 1000.0 / sync->fsync_period_ns;
+        uint32_t step  = (uint32_t)(elapsed + 0.5);
+        pulse          = dev->last_pulse + (step ? step : 1);
+        dev->resync    = false;
+    }
+    if (dev->tag_count == 0)
+    {
+        dev->first_index = index;
+    }
+    else
+    {
+        double elapsed = (double)(index - dev->last_index) / dev->fit_slope;
+        uint32_t step  = (uint32_t)(elapsed + 0.5);
+        pulse          = dev->last_pulse + (step ? step : 1);
+    }
+    dev->last_pulse  = pulse;
+    dev->last_index  = index;
+    dev->last_tag_us = tag_us;
+    dev->tag_count++;
+
+    x = (double)pulse;
+    y = (double)(index - dev->first_index);
+    dev->sw  = dev->sw * ICM_SYNC_FIT_FORGET + 1;
+    dev->sx  = dev->sx * ICM_SYNC_FIT_FORGET + x;
+    dev->sy  = dev->sy * ICM_SYNC_FIT_FORGET + y;
+    dev->sxx = dev->sxx * ICM_SYNC_FIT_FORGET + x * x;
+    dev->sxy = dev->sxy * ICM_SYNC_FIT_FORGET + x * y;
+
+    slope = (double)sync->fsync_period_ns / dev->nominal_period_ns;
+    det   = dev->sw * dev->sxx - dev->sx * dev->sx;
+    if ((dev->tag_count >= ICM_SYNC_FIT_MIN_TAGS) && (det > 0))
+    {
+        slope = (dev->sw * dev->sxy - dev->sx * dev->sy) / det;
+    }
+    dev->fit_slope  = slope;
+    dev->fit_offset = (double)dev->first_index + (dev->sy - slope * dev->sx) / dev->sw - 0.5;
+}
+
+/**
+ * @brief Forget the tags and the fit of a device after FIFO rows were lost.
+ *
+ * @note The lost rows break the sample index, so the device drops samples until the next rising tag. With
+ *       ctx->get_time_us that tag is placed back on the common timebase, without a host clock the device cannot
+ *       tell how many pulses it missed and stays tagless. The tag level is assumed high so a pulse already in
+ *       progress is not taken for a new edge.
+ */
+static void icmSyncLost(icm_sync_dev_t *dev, uint32_t fsync_period_ns)
+{
+    dev->resync        = dev->resync || (dev->tag_count > 0);
+    dev->tag_count     = 0;
+    dev->untagged_rows = 0;
+    dev->fsync_level   = true;
+    dev->sw            = 0;
+    dev->sx            = 0;
+    dev->sy            = 0;
+    dev->sxx           = 0;
+    dev->sxy           = 0;
+    dev->fit_offset    = 0;
+    dev->fit_slope     = (double)fsync_period_ns / dev->nominal_period_ns;
+}
+
+/**
+ * @brief Initialize an empty FSYNC alignment group.
+ *
+ * @note The first FSYNC pulse seen by each device is taken as time 0, so every device should be added and started
+ *       before the shared FSYNC signal starts toggling. The FSYNC period must not be close to an integer multiple
+ *       of any device sample period. Otherwise every edge lands at the same phase of a sample, the latch error
+ *       stays constant instead of averaging out and timestamps are off by up to half a sample period, e.g. 10 ms
+ *       FSYNC at 1 kHz gives up to 500 us where 10.37 ms gives about 30 us.
+ *
+ * @param fsync_period_ns Period of the shared FSYNC signal.
+ */
+void icmSyncInit(icm_sync_t *sync, uint32_t fsync_period_ns)
+{
+    memset(sync, 0, sizeof(*sync));
+    sync->fsync_period_ns = fsync_period_ns;
+    sync->merged_ns       = INT64_MIN;
+}
+
+/**
+ * @brief Add a device to the group and route FSYNC into its sample stream.
+ *
+ * @param ctx Device context, must stay valid while the group is used.
+ * @param accel Accelerometer is written to FIFO.
+ * @param gyro Gyroscope is written to FIFO.
+ * @param ext_sync Output register which carries the FSYNC tag @icm_ext_sync_t
+ * @param nominal_period_ns Configured output data period of the device.
+ * @param p_device Index of the device inside the group.
+ *
+ * @return ICM_ERR_PARAM if the group is full or the configuration has no tag channel, ICM_ERR_BUS if the tag
+ *         channel could not be set up, the device is not added then @icm_status_t
+ */
+icm_status_t icmSyncAddDevice(icm_sync_t *sync, icmdev_ctx_t *ctx, bool accel, bool gyro, icm_ext_sync_t ext_sync,
+                              uint32_t nominal_period_ns, uint8_t *p_device)
+{
+    icm_sync_dev_t *dev = NULL;
+    icm_status_t ret    = ICM_OK;
+
+    if ((sync->num_devices >= ICM_SYNC_MAX_DEVICES) || (ext_sync == ICM_EXT_SYNC_DISABLED)
+        || (nominal_period_ns == 0) || (!accel && !gyro))
+    {
+        return ICM_ERR_PARAM;
+    }
+    ret = icmSetFsync(ctx, ext_sync, false);
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+
+    dev = &sync->dev[sync->num_devices];
+    memset(dev, 0, sizeof(*dev));
+    dev->ctx               = ctx;
+    dev->accel             = accel;
+    dev->gyro              = gyro;
+    dev->row_len           = (accel && gyro) ? ICM_FIFO_ROW_LEN_BOTH : ICM_FIFO_ROW_LEN_SINGLE;
+    dev->ext_sync          = ext_sync;
+    dev->nominal_period_ns = nominal_period_ns;
+    dev->fit_slope         = (double)sync->fsync_period_ns / nominal_period_ns;
+    dev->last_ns           = INT64_MIN;
+
+    *p_device = sync->num_devices++;
+    return ICM_OK;
+}
+
+/**
+ * @brief Drain one device FIFO, detect FSYNC tags and timestamp its samples on the common timebase.
+ *
+ * @note Samples before the first tag of a device cannot be placed on the timebase and are dropped. Timestamps of a
+ *       device never decrease, a refit that would move a sample before its predecessor is clamped to it. At most as
+ *       many rows as fit into the device queue are read, the rest stays in the FIFO. A failed read queues nothing.
+ *       If rows were lost the FIFO is flushed, the tags and the fit of the device are cleared and it resynchronizes
+ *       on the next FSYNC tag, which needs ctx->get_time_us to find the pulse number again. A full FIFO is handled
+ *       the same way, the oldest rows may have been overwritten, and counts in dev->overflows.
+ *
+ * @param device Index returned from icmSyncAddDevice.
+ *
+ * @return ICM_ERR_PARAM for an unknown device, status of the FIFO read otherwise @icm_status_t
+ */
+icm_status_t icmSyncFetch(icm_sync_t *sync, uint8_t device)
+{
+    icm_sync_dev_t *dev = NULL;
+    uint16_t max_rows   = 0;
+    uint16_t rows       = 0;
+    uint16_t i          = 0;
+    uint32_t now_us     = 0;
+    icm_status_t ret    = ICM_OK;
+
+    if (device >= sync->num_devices)
+    {
+        return ICM_ERR_PARAM;
+    }
+    dev      = &sync->dev[device];
+    max_rows = ICM_SYNC_QUEUE_LEN - dev->count;
+    if (max_rows > ICM_FIFO_SIZE / dev->row_len)
+    {
+        max_rows = ICM_FIFO_SIZE / dev->row_len;
+    }
+    ret = icmReadFifo(dev->ctx, dev->row_len, sync->fifo_buf, max_rows, &rows);
+    if (ret == ICM_ERR_FIFO_LOST)
+    {
+        icmSyncLost(dev, sync->fsync_period_ns);
+    }
+    if (ret != ICM_OK)
+    {
+        return ret;
+    }
+    if (dev->ctx->state.fifo_count >= ICM_FIFO_SIZE)
+    {
+        dev->overflows++;
+        icmSyncLost(dev, sync->fsync_period_ns);
+    }
+    if (dev->ctx->get_time_us)
+    {
+        now_us = dev->ctx->get_time_us();
+    }
+
+    for (i = 0; i < rows; i++)
+    {
+        icm_raw_data_t raw   = {0};
+        bool level           = false;
+        icm_sync_sample_t *s = NULL;
+
+        icmParseFifoRow(&sync->fifo_buf[i * dev->row_len], dev->accel, dev->gyro, &raw);
+        level = icmSyncTagBit(dev, &raw);
+        if (level && !dev->fsync_level)
+        {
+            uint32_t age_us = (uint32_t)(((uint64_t)(rows - 1 - i) * dev->nominal_period_ns) / 1000);
+            icmSyncTag(sync, dev, dev->sample_index, now_us - age_us);
+        }
+        dev->fsync_level = level;
+
+        if (dev->tag_count == 0)
+        {
+            dev->dropped++;
+            dev->untagged_rows++;
+        }
+        else
+        {
+            int64_t timestamp_ns
+                = (int64_t)(((double)dev->sample_index - dev->fit_offset) / dev->fit_slope * sync->fsync_period_ns);
+
+            dev->last_ns    = (timestamp_ns > dev->last_ns) ? timestamp_ns : dev->last_ns;
+            s               = &dev->queue[(dev->head + dev->count) % ICM_SYNC_QUEUE_LEN];
+            s->device       = device;
+            s->data         = raw;
+            s->timestamp_ns = dev->last_ns;
+            dev->count++;
+        }
+        dev->sample_index++;
+    }
+    return ICM_OK;
+}
+
+static int64_t icmSyncHeadTime(const icm_sync_t *sync, uint8_t device)
+{
+    const icm_sync_dev_t *dev = &sync->dev[device];
+    return dev->queue[dev->head].timestamp_ns;
+}
+
+static bool icmSyncBefore(const icm_sync_t *sync, uint8_t a, uint8_t b)
+{
+    int64_t ta = icmSyncHeadTime(sync, a);
+    int64_t tb = icmSyncHeadTime(sync, b);
+    return (ta < tb) || ((ta == tb) && (a < b));
+}
+
+static void icmSyncSiftDown(const icm_sync_t *sync, uint8_t *heap, uint8_t size, uint8_t pos)
+{
+    for (;;)
+    {
+        uint8_t least = pos;
+        uint8_t left  = 2 * pos + 1;
+        uint8_t right = 2 * pos + 2;
+        uint8_t tmp   = 0;
+
+        if ((left < size) && icmSyncBefore(sync, heap[left], heap[least]))
+        {
+            least = left;
+        }
+        if ((right < size) && icmSyncBefore(sync, heap[right], heap[least]))
+        {
+            least = right;
+        }
+        if (least == pos)
+        {
+            return;
+        }
+        tmp         = heap[pos];
+        heap[pos]   = heap[least];
+        heap[least] = tmp;
+        pos         = least;
+    }
+}
+
+/**
+ * @brief Whether an empty device queue has to hold back the merge.
+ *
+ * @note A device stops holding back once it saw no tag for ICM_SYNC_TAG_TIMEOUT_PULSES FSYNC periods of its own
+ *       rows, or once its newest sample lags the newest sample of the group by as many periods, e.g. because its
+ *       fetches keep failing. It never holds back while another queue is full, waiting would overflow that FIFO.
+ */
+static bool icmSyncBlocks(const icm_sync_t *sync, const icm_sync_dev_t *dev)
+{
+    uint64_t timeout_ns = (uint64_t)ICM_SYNC_TAG_TIMEOUT_PULSES * sync->fsync_period_ns;
+    int64_t newest_ns   = 0;
+    int64_t last_ns     = (dev->last_ns == INT64_MIN) ? 0 : dev->last_ns;
+    uint8_t i           = 0;
+
+    if ((dev->tag_count == 0) && ((uint64_t)dev->untagged_rows * dev->nominal_period_ns >= timeout_ns))
+    {
+        return false;
+    }
+    for (i = 0; i < sync->num_devices; i++)
+    {
+        if (sync->dev[i].count >= ICM_SYNC_QUEUE_LEN)
+        {
+            return false;
+        }
+        newest_ns = (sync->dev[i].last_ns > newest_ns) ? sync->dev[i].last_ns : newest_ns;
+    }
+    return (newest_ns <= last_ns) || ((uint64_t)(newest_ns - last_ns) < timeout_ns);
+}
+
+/**
+ * @brief Merge the queued samples of all devices into one time ordered stream.
+ *
+ * @note Merging stops as soon as any device queue runs empty, because the next fetch from that device may still
+ *       produce an earlier sample. Fetch every device before each merge. A device that saw no tag or no new sample
+ *       for ICM_SYNC_TAG_TIMEOUT_PULSES FSYNC periods, e.g. with a broken FSYNC line, while it resynchronizes or
+ *       while its bus fails, no longer holds back the others, and no device does while another queue is full. Once
+ *       it delivers again its samples older than the last merged sample are dropped, so the merged stream never
+ *       goes back in time.
+ *
+ * @param p_out Destination for merged samples.
+ * @param max_samples Capacity of p_out.
+ * @param p_count Number of samples written.
+ */
+void icmSyncMerge(icm_sync_t *sync, icm_sync_sample_t *p_out, uint16_t max_samples, uint16_t *p_count)
+{
+    uint8_t heap[ICM_SYNC_MAX_DEVICES] = {0};
+    uint8_t size                       = 0;
+    uint16_t count                     = 0;
+    uint8_t i                          = 0;
+
+    *p_count = 0;
+    for (i = 0; i < sync->num_devices; i++)
+    {
+        icm_sync_dev_t *dev = &sync->dev[i];
+
+        while ((dev->count > 0) && (dev->queue[dev->head].timestamp_ns < sync->merged_ns))
+        {
+            dev->head = (dev->head + 1) % ICM_SYNC_QUEUE_LEN;
+            dev->count--;
+            dev->dropped++;
+        }
+        if (dev->count > 0)
+        {
+            heap[size++] = i;
+        }
+        else if (icmSyncBlocks(sync, dev))
+        {
+            return;
+        }
+    }
+    if (size == 0)
+    {
+        return;
+    }
+    for (i = size / 2; i-- > 0;)
+    {
+        icmSyncSiftDown(sync, heap, size, i);
+    }
+
+    while (count < max_samples)
+    {
+        icm_sync_dev_t *dev = &sync->dev[heap[0]];
+
+        p_out[count++]  = dev->queue[dev->head];
+        sync->merged_ns = dev->queue[dev->head].timestamp_ns;
+        dev->head       = (dev->head + 1) % ICM_SYNC_QUEUE_LEN;
+        dev->count--;
+        if (dev->count == 0)
+        {
+            if (icmSyncBlocks(sync, dev))
+            {
+                break;
+            }
+            heap[0] = heap[--size];
+            if (size == 0)
+            {
+                break;
+            }
+        }
+        icmSyncSiftDown(sync, heap, size, 0);
+    }
+    *p_count = count;
+}
+
+// EOF
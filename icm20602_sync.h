@@ -0,0 +1,72 @@
+#ifndef MAIN_INC_ICM20602_SYNC_H
+#define MAIN_INC_ICM20602_SYNC_H
+
+#include "icm20602.h"
+
+#ifndef ICM_SYNC_MAX_DEVICES
+#define ICM_SYNC_MAX_DEVICES 8
+#endif
+
+#ifndef ICM_SYNC_QUEUE_LEN
+#define ICM_SYNC_QUEUE_LEN 128
+#endif
+
+#ifndef ICM_SYNC_TAG_TIMEOUT_PULSES
+#define ICM_SYNC_TAG_TIMEOUT_PULSES 4 // FSYNC periods without a tag or new samples before a device stops blocking merge
+#endif
+
+#define ICM_SYNC_FIT_MIN_TAGS 4
+#define ICM_SYNC_FIT_FORGET   0.995
+
+typedef struct {
+    uint8_t device;
+    int64_t timestamp_ns;
+    icm_raw_data_t data;
+} icm_sync_sample_t;
+
+typedef struct {
+    icmdev_ctx_t *ctx;
+    bool accel;
+    bool gyro;
+    uint8_t row_len;
+    icm_ext_sync_t ext_sync;
+    uint32_t nominal_period_ns;
+    uint64_t sample_index;
+    bool fsync_level;
+    uint32_t tag_count;
+    bool resync;
+    uint32_t last_tag_us;
+    uint32_t last_pulse;
+    uint64_t last_index;
+    uint64_t first_index;
+    double sw;
+    double sx;
+    double sy;
+    double sxx;
+    double sxy;
+    double fit_offset;
+    double fit_slope;
+    uint32_t dropped;
+    uint32_t overflows;
+    uint32_t untagged_rows;
+    int64_t last_ns;
+    icm_sync_sample_t queue[ICM_SYNC_QUEUE_LEN];
+    uint16_t head;
+    uint16_t count;
+} icm_sync_dev_t;
+
+typedef struct {
+    icm_sync_dev_t dev[ICM_SYNC_MAX_DEVICES];
+    uint8_t num_devices;
+    uint32_t fsync_period_ns;
+    int64_t merged_ns;
+    uint8_t fifo_buf[ICM_FIFO_SIZE];
+} icm_sync_t;
+
+void icmSyncInit(icm_sync_t *sync, uint32_t fsync_period_ns);
+icm_status_t icmSyncAddDevice(icm_sync_t *sync, icmdev_ctx_t *ctx, bool accel, bool gyro, icm_ext_sync_t ext_sync,
+                              uint32_t nominal_period_ns, uint8_t *p_device);
+icm_status_t icmSyncFetch(icm_sync_t *sync, uint8_t device);
+void icmSyncMerge(icm_sync_t *sync, icm_sync_sample_t *p_out, uint16_t max_samples, uint16_t *p_count);
+
+#endif /* MAIN_INC_ICM20602_SYNC_H */
@@ -0,0 +1,329 @@
+/*
+ * Offline noise characterization of raw FIFO captures.
+ *
+ * The capture is the plain concatenation of FIFO rows as returned by icmReadFifo. Every axis gets its own streaming
+ * overlapping Allan variance estimator, the axes are spread over worker threads while the main thread reads and
+ * decodes the next block, so memory use does not depend on the capture length.
+ *
+ * Build: cc -O2 -I.. -o icm20602_allan icm20602_allan.c ../icm20602_allan.c ../icm20602.c -lpthread -lm
+ * Usage: icm20602_allan -r <odr_hz> [-l both|accel|gyro] [-a 0..3] [-g 0..3] [-j threads] [-c curve.csv] capture
+ */
+
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "icm20602_allan.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ICM_ALLAN_TOOL_BLOCK_ROWS 65536
+#define ICM_ALLAN_TOOL_CHANNELS   6
+#define ICM_ALLAN_TOOL_RAW_STRIDE (sizeof(icm_raw_data_t) / sizeof(int16_t))
+#define ICM_ALLAN_TOOL_G          9.80665f
+
+typedef struct {
+    const char *name;
+    bool gyro;
+    uint8_t axis;
+    float scale;
+    icm_allan_t allan;
+} icm_allan_channel_t;
+
+typedef struct {
+    icm_allan_channel_t channel[ICM_ALLAN_TOOL_CHANNELS];
+    uint8_t num_channels;
+    uint8_t num_threads;
+    pthread_mutex_t start;
+    pthread_barrier_t barrier;
+    const icm_raw_data_t *block;
+    uint32_t block_rows;
+    bool done;
+} icm_allan_tool_t;
+
+typedef struct {
+    icm_allan_tool_t *tool;
+    uint8_t index;
+} icm_allan_worker_t;
+
+static const char *icmAllanToolNames[ICM_ALLAN_TOOL_CHANNELS] = {
+    "accel_x", "accel_y", "accel_z", "gyro_x", "gyro_y", "gyro_z",
+};
+
+/**
+ * @brief Worker thread, runs the estimators of every channel with index modulo threads equal to its own.
+ */
+static void *icmAllanToolWorker(void *arg)
+{
+    icm_allan_worker_t *worker = (icm_allan_worker_t *)arg;
+    icm_allan_tool_t *tool     = worker->tool;
+    uint8_t c                  = 0;
+
+    pthread_mutex_lock(&tool->start);
+    pthread_mutex_unlock(&tool->start);
+    for (;;)
+    {
+        pthread_barrier_wait(&tool->barrier);
+        if (tool->done)
+        {
+            return NULL;
+        }
+        for (c = worker->index; c < tool->num_channels; c += tool->num_threads)
+        {
+            icm_allan_channel_t *channel = &tool->channel[c];
+            const int16_t *p_first       = channel->gyro ? &tool->block[0].gyro[channel->axis]
+                                                         : &tool->block[0].accel[channel->axis];
+
+            icmAllanAdd(&channel->allan, p_first, tool->block_rows, ICM_ALLAN_TOOL_RAW_STRIDE);
+        }
+        pthread_barrier_wait(&tool->barrier);
+    }
+}
+
+/**
+ * @brief Read up to one block of rows and decode them.
+ *
+ * @return Number of decoded rows, 0 at the end of the capture.
+ */
+static uint32_t icmAllanToolRead(FILE *file, uint8_t *p_bytes, uint8_t row_len, bool accel, bool gyro,
+                                 icm_raw_data_t *p_block)
+{
+    uint32_t rows = (uint32_t)(fread(p_bytes, row_len, ICM_ALLAN_TOOL_BLOCK_ROWS, file));
+    uint32_t i    = 0;
+
+    for (i = 0; i < rows; i++)
+    {
+        icmParseFifoRow(&p_bytes[(size_t)i * row_len], accel, gyro, &p_block[i]);
+    }
+    return rows;
+}
+
+/**
+ * @brief Print the noise coefficients of one channel, gyro in deg and hours, accel in mg and seconds.
+ */
+static void icmAllanToolReport(const icm_allan_channel_t *channel, const icm_allan_noise_t *noise)
+{
+    if (channel->gyro)
+    {
+        printf("%-8s ARW %10.5f deg/sqrt(h)  BI %10.4f deg/h @ %8.1f s  RRW %10.4f deg/h/sqrt(h)\n", channel->name,
+               noise->random_walk * 60.0f, noise->bias_instability * 3600.0f, noise->bias_instability_tau_s,
+               noise->rate_random_walk * 3600.0f * 60.0f);
+    }
+    else
+    {
+        printf("%-8s VRW %10.5f m/s/sqrt(h) BI %10.4f mg    @ %8.1f s  RRW %10.6f mg/sqrt(s)\n", channel->name,
+               noise->random_walk * ICM_ALLAN_TOOL_G * 0.06f, noise->bias_instability, noise->bias_instability_tau_s,
+               noise->rate_random_walk);
+    }
+}
+
+static void icmAllanToolUsage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s -r <odr_hz> [-l both|accel|gyro] [-a accel_range 0..3] [-g gyro_range 0..3] [-j threads]\n"
+            "       [-c curve.csv] capture\n",
+            argv0);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint16_t gyro_sensitivity[] = {
+        ICM_GYRO_SENSITIVITY_250_DPS,
+        ICM_GYRO_SENSITIVITY_500_DPS,
+        ICM_GYRO_SENSITIVITY_1000_DPS,
+        ICM_GYRO_SENSITIVITY_2000_DPS,
+    };
+    static icm_allan_tool_t tool;
+    static icm_allan_point_t points[ICM_ALLAN_TAUS];
+    icm_allan_worker_t workers[ICM_ALLAN_TOOL_CHANNELS];
+    pthread_t threads[ICM_ALLAN_TOOL_CHANNELS];
+    icm_raw_data_t *blocks[2]  = {NULL, NULL};
+    uint8_t *p_bytes           = NULL;
+    const char *curve_path     = NULL;
+    FILE *file                 = NULL;
+    FILE *curve                = NULL;
+    float odr_hz               = 0;
+    bool accel                 = true;
+    bool gyro                  = true;
+    uint8_t accel_range        = ICM_ACCEL_RANGE_2G;
+    uint8_t gyro_range         = ICM_GYRO_RANGE_250_DPS;
+    uint8_t row_len            = 0;
+    uint8_t threads_wanted     = ICM_ALLAN_TOOL_CHANNELS;
+    uint32_t rows              = 0;
+    uint64_t total_rows        = 0;
+    uint8_t current            = 0;
+    uint8_t started            = 0;
+    uint8_t c                  = 0;
+    int opt                    = 0;
+
+    while ((opt = getopt(argc, argv, "r:l:a:g:j:c:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            odr_hz = strtof(optarg, NULL);
+            break;
+        case 'l':
+            accel = (strcmp(optarg, "gyro") != 0);
+            gyro  = (strcmp(optarg, "accel") != 0);
+            break;
+        case 'a':
+            accel_range = (uint8_t)atoi(optarg) & 0x03;
+            break;
+        case 'g':
+            gyro_range = (uint8_t)atoi(optarg) & 0x03;
+            break;
+        case 'j':
+            threads_wanted = (uint8_t)atoi(optarg);
+            break;
+        case 'c':
+            curve_path = optarg;
+            break;
+        default:
+            icmAllanToolUsage(argv[0]);
+            return 1;
+        }
+    }
+    if ((optind != argc - 1) || (odr_hz <= 0))
+    {
+        icmAllanToolUsage(argv[0]);
+        return 1;
+    }
+
+    file = fopen(argv[optind], "rb");
+    if (file == NULL)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    for (c = 0; c < ICM_ALLAN_TOOL_CHANNELS; c++)
+    {
+        icm_allan_channel_t *channel = NULL;
+        bool is_gyro                 = (c >= 3);
+
+        if ((is_gyro && !gyro) || (!is_gyro && !accel))
+        {
+            continue;
+        }
+        channel        = &tool.channel[tool.num_channels++];
+        channel->name  = icmAllanToolNames[c];
+        channel->gyro  = is_gyro;
+        channel->axis  = c % 3;
+        channel->scale = is_gyro ? 10.0f / gyro_sensitivity[gyro_range]
+                                 : 1000.0f / (float)(1 << (ICM_ACCEL_SENSITIVITY_SHIFT_2G - accel_range));
+        icmAllanInit(&channel->allan);
+    }
+
+    row_len          = (accel && gyro) ? ICM_FIFO_ROW_LEN_BOTH : ICM_FIFO_ROW_LEN_SINGLE;
+    tool.num_threads = (threads_wanted == 0) ? 1 : threads_wanted;
+    tool.num_threads = (tool.num_threads > tool.num_channels) ? tool.num_channels : tool.num_threads;
+    blocks[0]        = malloc(ICM_ALLAN_TOOL_BLOCK_ROWS * sizeof(icm_raw_data_t));
+    blocks[1]        = malloc(ICM_ALLAN_TOOL_BLOCK_ROWS * sizeof(icm_raw_data_t));
+    p_bytes          = malloc((size_t)ICM_ALLAN_TOOL_BLOCK_ROWS * row_len);
+    if ((blocks[0] == NULL) || (blocks[1] == NULL) || (p_bytes == NULL))
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    /* workers wait at the start gate until the barrier is sized to the threads that actually started */
+    pthread_mutex_init(&tool.start, NULL);
+    pthread_mutex_lock(&tool.start);
+    for (started = 0; started < tool.num_threads; started++)
+    {
+        workers[started].tool  = &tool;
+        workers[started].index = started;
+        if (pthread_create(&threads[started], NULL, icmAllanToolWorker, &workers[started]) != 0)
+        {
+            break;
+        }
+    }
+    tool.done = (started < tool.num_threads);
+    pthread_barrier_init(&tool.barrier, NULL, started + 1);
+    pthread_mutex_unlock(&tool.start);
+    if (tool.done)
+    {
+        fprintf(stderr, "cannot start worker thread %u of %u\n", started + 1, tool.num_threads);
+        pthread_barrier_wait(&tool.barrier);
+        for (c = 0; c < started; c++)
+        {
+            pthread_join(threads[c], NULL);
+        }
+        pthread_barrier_destroy(&tool.barrier);
+        pthread_mutex_destroy(&tool.start);
+        fclose(file);
+        free(blocks[0]);
+        free(blocks[1]);
+        free(p_bytes);
+        return 1;
+    }
+
+    /* workers run on one block while the next one is read and decoded */
+    rows = icmAllanToolRead(file, p_bytes, row_len, accel, gyro, blocks[current]);
+    while (rows > 0)
+    {
+        tool.block      = blocks[current];
+        tool.block_rows = rows;
+        total_rows += rows;
+        pthread_barrier_wait(&tool.barrier);
+        current = current ^ 1;
+        rows    = icmAllanToolRead(file, p_bytes, row_len, accel, gyro, blocks[current]);
+        pthread_barrier_wait(&tool.barrier);
+    }
+    tool.done = true;
+    pthread_barrier_wait(&tool.barrier);
+    for (c = 0; c < tool.num_threads; c++)
+    {
+        pthread_join(threads[c], NULL);
+    }
+    pthread_barrier_destroy(&tool.barrier);
+    pthread_mutex_destroy(&tool.start);
+    fclose(file);
+
+    printf("%llu rows, %.1f s at %.1f Hz\n", (unsigned long long)total_rows, (double)(total_rows / odr_hz),
+           (double)odr_hz);
+    if (curve_path != NULL)
+    {
+        curve = fopen(curve_path, "w");
+        if (curve == NULL)
+        {
+            perror(curve_path);
+        }
+        else
+        {
+            fprintf(curve, "channel,tau_s,adev,terms\n");
+        }
+    }
+
+    for (c = 0; c < tool.num_channels; c++)
+    {
+        icm_allan_channel_t *channel = &tool.channel[c];
+        icm_allan_noise_t noise      = {0};
+        uint8_t count                = icmAllanResult(&channel->allan, 1.0f / odr_hz, channel->scale, points);
+        uint8_t i                    = 0;
+
+        icmAllanNoise(points, count, &noise);
+        icmAllanToolReport(channel, &noise);
+        for (i = 0; (curve != NULL) && (i < count); i++)
+        {
+            fprintf(curve, "%s,%g,%g,%llu\n", channel->name, (double)points[i].tau_s, (double)points[i].adev,
+                    (unsigned long long)points[i].terms);
+        }
+    }
+
+    if (curve != NULL)
+    {
+        fclose(curve);
+    }
+    free(blocks[0]);
+    free(blocks[1]);
+    free(p_bytes);
+    return 0;
+}
+
+// EOF
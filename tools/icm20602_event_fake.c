@@ -0,0 +1,274 @@
+/*
+ * Fake interrupt check of the event layer, no hardware needed.
+ *
+ * Every device gets an eventfd and a simulated FIFO behind a fake bus. Each round a random subset of devices
+ * produces rows and raises its eventfd, some twice so coalesced notifications are covered, then a single epoll loop
+ * dispatches until idle. Optionally one device per round fails a FIFO burst, the others must still be served and
+ * the failed one must recover through icmService without a new notification. Rows handed to the handler must match
+ * the rows produced minus the rows lost, otherwise the check fails.
+ *
+ * Build: cc -O2 -I.. -o icm20602_event_fake icm20602_event_fake.c ../icm20602_event.c ../icm20602.c -lm
+ * Usage: icm20602_event_fake [-n devices] [-r rounds] [-f] [-s seed]
+ */
+
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "icm20602_event.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define ICM_EVENT_FAKE_MAX_DEVICES 64
+#define ICM_EVENT_FAKE_ROW_LEN     ICM_FIFO_ROW_LEN_BOTH
+#define ICM_EVENT_FAKE_MAX_ROWS    (ICM_FIFO_SIZE / ICM_EVENT_FAKE_ROW_LEN)
+
+typedef struct {
+    uint16_t fifo_rows;
+    uint32_t next_seq;
+    uint32_t expect_seq;
+    bool fail_pop;
+    uint32_t produced;
+    uint32_t received;
+    uint32_t lost;
+    uint32_t bad_rows;
+} icm_event_fake_t;
+
+/**
+ * @brief Fake bus read, FIFO rows carry a per device sequence number in the accel X and Y words.
+ */
+static int32_t icmEventFakeRead(void *handle, uint8_t reg, uint8_t *p_buf, uint16_t len)
+{
+    icm_event_fake_t *fake = (icm_event_fake_t *)handle;
+    uint16_t i             = 0;
+
+    memset(p_buf, 0, len);
+    if (reg == ICM_REG_FIFO_COUNTH)
+    {
+        uint16_t count = fake->fifo_rows * ICM_EVENT_FAKE_ROW_LEN;
+        p_buf[0]       = (uint8_t)(count >> 8);
+        p_buf[1]       = (uint8_t)count;
+    }
+    else if (reg == ICM_REG_FIFO_R_W)
+    {
+        uint16_t rows = len / ICM_EVENT_FAKE_ROW_LEN;
+
+        if (rows > fake->fifo_rows)
+        {
+            rows = fake->fifo_rows;
+        }
+        fake->fifo_rows -= rows;
+        if (fake->fail_pop)
+        {
+            /* the rows left the FIFO but never reached the host */
+            fake->fail_pop = false;
+            fake->next_seq += rows;
+            fake->lost += rows;
+            return -1;
+        }
+        for (i = 0; i < rows; i++)
+        {
+            uint8_t *p_row = &p_buf[i * ICM_EVENT_FAKE_ROW_LEN];
+            uint32_t seq   = fake->next_seq++;
+            p_row[0]       = (uint8_t)(seq >> 24);
+            p_row[1]       = (uint8_t)(seq >> 16);
+            p_row[2]       = (uint8_t)(seq >> 8);
+            p_row[3]       = (uint8_t)seq;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fake bus write, only USER_CTRL.FIFO_RST has an effect.
+ */
+static int32_t icmEventFakeWrite(void *handle, uint8_t reg, const uint8_t *p_buf, uint16_t len)
+{
+    icm_event_fake_t *fake = (icm_event_fake_t *)handle;
+    icm_user_ctrl_t user_ctrl;
+
+    (void)len;
+    user_ctrl.user_ctrl = p_buf[0];
+    if ((reg == ICM_REG_USER_CTRL) && user_ctrl.bits.fifo_rst)
+    {
+        fake->lost += fake->fifo_rows;
+        fake->next_seq += fake->fifo_rows;
+        fake->fifo_rows = 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Row handler, checks that rows arrive in sequence apart from gaps left by lost rows.
+ */
+static void icmEventFakeHandler(void *arg, const uint8_t *p_rows, uint16_t rows, uint8_t row_len)
+{
+    icm_event_fake_t *fake = (icm_event_fake_t *)arg;
+    uint16_t i             = 0;
+
+    for (i = 0; i < rows; i++)
+    {
+        const uint8_t *p_row = &p_rows[i * row_len];
+        uint32_t seq         = ((uint32_t)p_row[0] << 24) | ((uint32_t)p_row[1] << 16);
+
+        seq |= ((uint32_t)p_row[2] << 8) | p_row[3];
+        if (seq < fake->expect_seq)
+        {
+            fake->bad_rows++;
+        }
+        fake->expect_seq = seq + 1;
+        fake->received++;
+    }
+}
+
+static void icmEventFakeUsage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-n devices 1..%d] [-r rounds] [-f] [-s seed]\n", argv0, ICM_EVENT_FAKE_MAX_DEVICES);
+}
+
+int main(int argc, char **argv)
+{
+    static icm_event_fake_t fakes[ICM_EVENT_FAKE_MAX_DEVICES];
+    static icm_event_dev_t devs[ICM_EVENT_FAKE_MAX_DEVICES];
+    static icmdev_ctx_t ctxs[ICM_EVENT_FAKE_MAX_DEVICES];
+    uint32_t num_devices = 16;
+    uint32_t rounds      = 1000;
+    uint32_t round       = 0;
+    uint32_t failures    = 0;
+    uint32_t produced    = 0;
+    uint32_t received    = 0;
+    uint32_t lost        = 0;
+    uint32_t bad_rows    = 0;
+    unsigned int seed    = 1;
+    bool inject          = false;
+    int epfd             = -1;
+    int opt              = 0;
+    uint32_t d           = 0;
+
+    while ((opt = getopt(argc, argv, "n:r:fs:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            num_devices = (uint32_t)atoi(optarg);
+            break;
+        case 'r':
+            rounds = (uint32_t)atoi(optarg);
+            break;
+        case 'f':
+            inject = true;
+            break;
+        case 's':
+            seed = (unsigned int)atoi(optarg);
+            break;
+        default:
+            icmEventFakeUsage(argv[0]);
+            return 1;
+        }
+    }
+    if ((optind != argc) || (num_devices == 0) || (num_devices > ICM_EVENT_FAKE_MAX_DEVICES))
+    {
+        icmEventFakeUsage(argv[0]);
+        return 1;
+    }
+    srand(seed);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+    {
+        perror("epoll_create1");
+        return 1;
+    }
+    for (d = 0; d < num_devices; d++)
+    {
+        ctxs[d].read_reg  = icmEventFakeRead;
+        ctxs[d].write_reg = icmEventFakeWrite;
+        ctxs[d].handle    = &fakes[d];
+        icmEventInit(&devs[d], &ctxs[d], ICM_EVENT_FAKE_ROW_LEN, icmEventFakeHandler, &fakes[d]);
+        if ((icmEventOpenEventfd(&devs[d]) < 0) || (icmEventRegister(epfd, &devs[d]) < 0))
+        {
+            perror("eventfd");
+            return 1;
+        }
+    }
+
+    for (round = 0; round < rounds; round++)
+    {
+        uint32_t victim = inject ? (uint32_t)rand() % num_devices : num_devices;
+        int ret         = 0;
+
+        for (d = 0; d < num_devices; d++)
+        {
+            uint16_t rows = 0;
+
+            if ((rand() % 3) != 0)
+            {
+                continue;
+            }
+            rows = (uint16_t)(1 + rand() % ICM_EVENT_FAKE_MAX_ROWS);
+            if (fakes[d].fifo_rows + rows > ICM_EVENT_FAKE_MAX_ROWS)
+            {
+                rows = ICM_EVENT_FAKE_MAX_ROWS - fakes[d].fifo_rows;
+            }
+            fakes[d].fifo_rows += rows;
+            fakes[d].produced += rows;
+            fakes[d].fail_pop = (d == victim) && (rows > 0);
+            icmEventSignal(&devs[d]);
+            if ((rand() % 4) == 0)
+            {
+                icmEventSignal(&devs[d]);
+            }
+        }
+
+        do
+        {
+            ret = icmEventDispatch(epfd, 0);
+            if (ret < 0)
+            {
+                failures++;
+            }
+        } while (ret != 0);
+
+        /* what a dispatch timeout would do: retry devices that failed without waiting for a new edge */
+        for (d = 0; d < num_devices; d++)
+        {
+            if (devs[d].needs_service && (icmService(&devs[d]) < 0))
+            {
+                failures++;
+            }
+        }
+    }
+
+    for (d = 0; d < num_devices; d++)
+    {
+        produced += fakes[d].produced;
+        received += fakes[d].received;
+        lost += fakes[d].lost;
+        bad_rows += fakes[d].bad_rows;
+        if ((fakes[d].fifo_rows != 0) || devs[d].needs_service
+            || (fakes[d].received + fakes[d].lost != fakes[d].produced))
+        {
+            fprintf(stderr, "device %u: produced %u received %u lost %u left %u\n", d, fakes[d].produced,
+                    fakes[d].received, fakes[d].lost, fakes[d].fifo_rows);
+            bad_rows++;
+        }
+        icmEventClose(&devs[d]);
+    }
+    close(epfd);
+
+    printf("%u devices, %u rounds: produced %u received %u lost %u failures %u bad %u\n", num_devices, rounds,
+           produced, received, lost, failures, bad_rows);
+    if ((bad_rows != 0) || (!inject && ((lost != 0) || (failures != 0))))
+    {
+        printf("FAIL\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
+
+// EOF
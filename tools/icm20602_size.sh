@@ -0,0 +1,59 @@
+#!/bin/sh
+#
+# Footprint of icm20602.c for each build configuration.
+#
+# Usage: tools/icm20602_size.sh [baseline]
+#
+# Prints text, data and bss of the object and the size of the per device driver state (icm_dev_t inside
+# icmdev_ctx_t) per configuration. With a baseline file from an earlier run, every configuration that grew is
+# reported and the script exits with 1.
+# Cross compile with e.g. CC=arm-none-eabi-gcc SIZE=arm-none-eabi-size NM=arm-none-eabi-nm CFLAGS="-Os -mthumb".
+
+CC=${CC:-cc}
+SIZE=${SIZE:-size}
+NM=${NM:-nm}
+CFLAGS=${CFLAGS:--Os}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+MINIMAL="-DICM_CFG_WOM=0 -DICM_CFG_OFFSETS=0 -DICM_CFG_FIFO_READERS=0 -DICM_CFG_TEMPERATURE=0 -DICM_CFG_SELF_TEST=0"
+MINIMAL="$MINIMAL -DICM_CFG_RATE_PLAN=0 -DICM_CFG_WM_CTRL=0 -DICM_CFG_AUTORANGE=0 -DICM_CFG_SNAPSHOT=0"
+
+# name|flags
+CONFIGS="full|
+full_float|-DICM_CFG_FIXED_POINT=0
+both|-DICM_CFG_LAYOUT=ICM_CFG_LAYOUT_BOTH
+accel|-DICM_CFG_LAYOUT=ICM_CFG_LAYOUT_ACCEL
+gyro|-DICM_CFG_LAYOUT=ICM_CFG_LAYOUT_GYRO
+minimal_both|$MINIMAL -DICM_CFG_LAYOUT=ICM_CFG_LAYOUT_BOTH
+minimal_accel|$MINIMAL -DICM_CFG_LAYOUT=ICM_CFG_LAYOUT_ACCEL
+minimal_gyro|$MINIMAL -DICM_CFG_LAYOUT=ICM_CFG_LAYOUT_GYRO
+minimal_gyro_float|$MINIMAL -DICM_CFG_LAYOUT=ICM_CFG_LAYOUT_GYRO -DICM_CFG_FIXED_POINT=0"
+
+printf "%-20s %8s %8s %8s %8s %8s\n" config text data bss total state
+echo "$CONFIGS" | while IFS='|' read -r name flags; do
+    # shellcheck disable=SC2086
+    if ! $CC $CFLAGS $flags -I"$ROOT" -c "$ROOT/icm20602.c" -o "$OUT/$name.o"; then
+        echo "$name: build failed" >&2
+        exit 1
+    fi
+    # shellcheck disable=SC2046
+    set -- $($SIZE "$OUT/$name.o" | tail -n 1)
+    # shellcheck disable=SC2086
+    if ! echo '#include "icm20602.h"
+icm_dev_t icm_state_probe = {0};' | $CC $CFLAGS $flags -I"$ROOT" -x c -c - -o "$OUT/$name.probe.o"; then
+        echo "$name: probe failed" >&2
+        exit 1
+    fi
+    state=$($NM -S "$OUT/$name.probe.o" | awk '$4 == "icm_state_probe" { print $2 }')
+    printf "%-20s %8d %8d %8d %8d %8d\n" "$name" "$1" "$2" "$3" "$4" "$((0x${state:-0}))"
+done > "$OUT/report" || exit 1
+cat "$OUT/report"
+
+if [ -n "$1" ]; then
+    awk 'NR == FNR { if (FNR > 1) base[$1] = $5; next }
+         ($1 in base) && ($5 > base[$1]) { printf "%s grew by %d bytes\n", $1, $5 - base[$1]; grew = 1 }
+         END { exit grew }' "$1" "$OUT/report"
+fi